@@ -0,0 +1,230 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "benchbot.hpp"
+#include "util/printer.hpp"
+
+/**
+ * BenchBotStats.
+ */
+
+BenchBotStats::BenchBotStats() :
+    packetsIn(0),
+    packetsOut(0),
+    incomingTotal(0),
+    outgoingTotal(0),
+    bandwidthSamples(0),
+    lostEchoes(0) { }
+
+/**
+ * BenchBot.
+ */
+
+void BenchBot::transmit(const sky::ClientPacket &packet,
+                        const tg::Channel channel) {
+  if (!server) return;
+  telegraph.transmit(host, server, packet, channel);
+  stats.packetsOut++;
+}
+
+void BenchBot::processPacket(const sky::ServerPacket &packet,
+                             const Time now) {
+  using namespace sky;
+
+  switch (packet.type) {
+    case ServerPacket::Type::Init: {
+      pid = packet.pid.get();
+      if (admin) {
+        transmit(ClientPacket::RCon("auth"));
+        transmit(ClientPacket::RCon("start"));
+      }
+      break;
+    }
+
+    case ServerPacket::Type::InitSky: {
+      const auto &init = packet.skyInit.get();
+      hasSky = true;
+      dimensions = init.dimensions;
+      telegraph.setPackingBounds(dimensions);
+      plane.reset();
+      const auto participation = init.participations.find(*pid);
+      if (participation != init.participations.end()
+          and participation->second.spawn) {
+        plane = participation->second.spawn->second;
+      }
+      break;
+    }
+
+    case ServerPacket::Type::DeltaSky: {
+      if (hasSky) processSkyDelta(packet.skyDelta.get(), now);
+      break;
+    }
+
+    case ServerPacket::Type::DeltaSkyHandle: {
+      // the sky went away, or is about to be replaced
+      hasSky = false;
+      plane.reset();
+      break;
+    }
+
+    case ServerPacket::Type::Ping: {
+      transmit(ClientPacket::Pong(packet.timestamp.get(), now));
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+void BenchBot::processSkyDelta(const sky::SkyDelta &delta, const Time now) {
+  const auto iter = delta.participations.find(*pid);
+  if (iter == delta.participations.end()) return;
+  const auto &participation = iter->second;
+
+  if (participation.spawn) {
+    plane = participation.spawn->second;
+  } else if (!participation.planeAlive) {
+    plane.reset();
+  } else if (plane) {
+    // we'd have authority over the physical state, but we're a bot and
+    // simply follow the server
+    if (participation.state) plane = participation.state.get();
+    if (participation.stateDelta) participation.stateDelta->apply(*plane);
+  }
+
+  if (probeSequence) {
+    if (participation.inputAck
+        and int32_t(*participation.inputAck - *probeSequence) >= 0) {
+      stats.echoLatencies.push_back(TimeDiff(now - *probeStart));
+      probeStart.reset();
+      probeSequence.reset();
+    } else if (now - *probeStart > 2) {
+      stats.lostEchoes++;
+      probeStart.reset();
+      probeSequence.reset();
+    }
+  }
+}
+
+void BenchBot::sendInput(const Time now) {
+  sky::ParticipationInput input;
+  input.sequence = ++inputSequence;
+  input.controls = controls;
+  if (probeStart and !probeSequence) probeSequence = input.sequence;
+
+  if (plane) {
+    // wander around, like a (very bad) player would
+    std::uniform_real_distribution<float> jitter(-5, 5);
+    auto &physical = plane->physical;
+    physical.pos.x = clamp(0.0f, dimensions.x, physical.pos.x + jitter(rng));
+    physical.pos.y = clamp(0.0f, dimensions.y, physical.pos.y + jitter(rng));
+    physical.rot += jitter(rng);
+    input.planeState.emplace(*plane);
+  }
+
+  transmit(sky::ClientPacket::ReqInput(input), tg::Channel::Snapshot);
+}
+
+BenchBot::BenchBot(const std::string &nickname, const bool admin,
+                   const Port port, const unsigned int seed) :
+    host(tg::HostType::Client),
+    server(nullptr),
+    nickname(nickname),
+    admin(admin),
+    hasSky(false),
+    rng(seed),
+    inputTimer(0.03),
+    actionTimer(0.25),
+    skyRequestTimer(0.5),
+    spawnTimer(1),
+    bandwidthTimer(1),
+    inputSequence(0) {
+  host.connect("localhost", port);
+}
+
+void BenchBot::poll(const Time now) {
+  for (;;) {
+    const ENetEvent event = host.poll();
+    switch (event.type) {
+      case ENET_EVENT_TYPE_NONE:
+        return;
+      case ENET_EVENT_TYPE_CONNECT: {
+        server = event.peer;
+        transmit(sky::ClientPacket::ReqJoin(nickname));
+        break;
+      }
+      case ENET_EVENT_TYPE_DISCONNECT: {
+        server = nullptr;
+        appLog("Bot " + inQuotes(nickname) + " was disconnected!",
+               LogOrigin::Error);
+        break;
+      }
+      case ENET_EVENT_TYPE_RECEIVE: {
+        stats.packetsIn++;
+        if (const auto packet = telegraph.receive(event.packet))
+          processPacket(*packet, now);
+        break;
+      }
+    }
+  }
+}
+
+void BenchBot::tick(const TimeDiff delta, const Time now) {
+  host.tick(delta);
+  if (bandwidthTimer.cool(delta)) {
+    stats.incomingTotal += host.incomingBandwidth();
+    stats.outgoingTotal += host.outgoingBandwidth();
+    stats.bandwidthSamples++;
+    bandwidthTimer.reset();
+  }
+
+  if (!pid) return;
+
+  if (!hasSky) {
+    // the server ignores this until a game is running
+    if (skyRequestTimer.cool(delta)) {
+      transmit(sky::ClientPacket::ReqSky());
+      skyRequestTimer.reset();
+    }
+    return;
+  }
+
+  if (!plane and spawnTimer.cool(delta)) {
+    transmit(sky::ClientPacket::ReqSpawn());
+    spawnTimer.reset();
+  }
+
+  if (actionTimer.cool(delta)) {
+    // flip a random movement / weapon control
+    std::uniform_int_distribution<int> pick(
+        int(sky::Action::Thrust), int(sky::Action::Primary));
+    const auto action = sky::Action(pick(rng));
+    controls.doAction(action, !controls.getState(action));
+    if (!probeStart) probeStart = now;
+    actionTimer.reset();
+  }
+
+  if (inputTimer.cool(delta)) {
+    sendInput(now);
+    inputTimer.reset();
+  }
+}
+
+bool BenchBot::isPlaying() const {
+  return hasSky;
+}
@@ -0,0 +1,91 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Headless bot clients for benchmarking the server.
+ */
+#pragma once
+#include <random>
+#include "util/telegraph.hpp"
+#include "engine/protocol.hpp"
+
+/**
+ * What a bot measured over its run.
+ */
+struct BenchBotStats {
+  BenchBotStats();
+
+  unsigned long packetsIn, packetsOut;
+  Kbps incomingTotal, outgoingTotal; // summed over bandwidthSamples
+  unsigned int bandwidthSamples;
+  // From a control change to the ack of the input carrying it.
+  std::vector<TimeDiff> echoLatencies;
+  unsigned long lostEchoes;
+
+};
+
+/**
+ * A synthetic client: joins the arena, asks for the sky, spawns, and sends
+ * randomized inputs, timing how long the server takes to echo its control
+ * changes back. Tracks its own plane's state straight from the deltas,
+ * without running an engine.
+ */
+class BenchBot {
+ private:
+  // Network.
+  tg::Host host;
+  tg::Telegraph<sky::ServerPacket> telegraph;
+  ENetPeer *server;
+
+  // Connection state.
+  const std::string nickname;
+  const bool admin; // starts the game
+  optional<PID> pid;
+  bool hasSky;
+  sf::Vector2f dimensions;
+  optional<sky::PlaneState> plane;
+  sky::PlaneControls controls;
+
+  // Input generation.
+  std::mt19937 rng;
+  Cooldown inputTimer, actionTimer, skyRequestTimer, spawnTimer,
+      bandwidthTimer;
+
+  // Echo probe: when we last changed controls, and once an input carries
+  // the change, its sequence. The server acks later inputs too, so we
+  // don't lose track when the controls change again meanwhile.
+  uint32_t inputSequence;
+  optional<Time> probeStart;
+  optional<uint32_t> probeSequence;
+
+  void transmit(const sky::ClientPacket &packet,
+                const tg::Channel channel = tg::Channel::Reliable);
+  void processPacket(const sky::ServerPacket &packet, const Time now);
+  void processSkyDelta(const sky::SkyDelta &delta, const Time now);
+  void sendInput(const Time now);
+
+ public:
+  BenchBot(const std::string &nickname, const bool admin,
+           const Port port, const unsigned int seed);
+
+  BenchBotStats stats;
+
+  void poll(const Time now);
+  void tick(const TimeDiff delta, const Time now);
+  bool isPlaying() const;
+
+};
@@ -0,0 +1,174 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Server benchmark: runs a VanillaServer on loopback against a crowd of
+ * headless bots, and reports how it copes.
+ *
+ * solemnsky_bench_server [bots] [seconds] [environment]
+ */
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include "server/server.hpp"
+#include "server/servers/vanilla.hpp"
+#include "benchbot.hpp"
+
+/**
+ * Allocation counting, for the thread running the server.
+ */
+static thread_local unsigned long threadAllocations = 0;
+
+void *operator new(std::size_t size) {
+  threadAllocations++;
+  if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+const Port benchPort = 4343;
+
+TimeDiff percentile(std::vector<TimeDiff> samples, const float fraction) {
+  if (samples.empty()) return 0;
+  std::sort(samples.begin(), samples.end());
+  const size_t index = std::min(samples.size() - 1,
+                                size_t(fraction * samples.size()));
+  return samples[index];
+}
+
+std::string showMillis(const TimeDiff x) {
+  std::stringstream str;
+  str << std::fixed << std::setprecision(3) << (x * 1000.0f) << "ms";
+  return str.str();
+}
+
+/**
+ * Runs the bots until the time is up, then stops the server.
+ */
+void runBots(std::vector<std::unique_ptr<BenchBot>> &bots,
+             const TimeDiff duration,
+             ServerExec &exec) {
+  sf::Clock clock;
+  TimeDiff lastTick = 0;
+  bool announced = false;
+
+  while (clock.getElapsedTime().asSeconds() < duration) {
+    const Time now = clock.getElapsedTime().asSeconds();
+    const auto delta = TimeDiff(now - lastTick);
+    lastTick = TimeDiff(now);
+
+    for (auto &bot : bots) {
+      bot->poll(now);
+      bot->tick(delta, now);
+    }
+
+    if (!announced and std::all_of(
+        bots.begin(), bots.end(),
+        [](const std::unique_ptr<BenchBot> &bot) {
+          return bot->isPlaying();
+        })) {
+      appLog("All bots are in the game at "
+                 + showMillis(TimeDiff(now)) + ".", LogOrigin::App);
+      announced = true;
+    }
+
+    sf::sleep(sf::milliseconds(1));
+  }
+
+  exec.running = false;
+}
+
+}
+
+int main(int argc, char **argv) {
+  const int botCount = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 16;
+  const TimeDiff duration = (argc > 2) ? TimeDiff(std::atof(argv[2])) : 20;
+  const std::string environment = (argc > 3) ? argv[3] : "NULL";
+
+  tg::UsageFlag flag;
+  ServerExec exec(benchPort, sky::ArenaInit("bench", environment),
+                  [](ServerShared &shared) {
+                    return std::make_unique<VanillaServer>(shared);
+                  });
+
+  std::vector<std::unique_ptr<BenchBot>> bots;
+  for (int i = 0; i < botCount; i++) {
+    bots.emplace_back(std::make_unique<BenchBot>(
+        "bot" + std::to_string(i), i == 0, benchPort, unsigned(i)));
+  }
+
+  // The server keeps the main thread; the bots get their own.
+  std::thread botThread([&]() { runBots(bots, duration, exec); });
+  const unsigned long allocationsBefore = threadAllocations;
+  exec.run();
+  const unsigned long allocations = threadAllocations - allocationsBefore;
+  botThread.join();
+
+  // Report.
+  const auto &loop = exec.getLoopStats();
+  std::cout << "\n" << botCount << " bots, " << duration << "s, environment "
+            << inQuotes(environment) << "\n\n";
+
+  std::cout << "ticks: " << loop.ticks
+            << ", overruns: " << loop.overruns
+            << ", dropped: " << loop.droppedTicks << "\n";
+  std::cout << "tick time: p50 " << showMillis(loop.tickTimePercentile(0.5))
+            << ", p90 " << showMillis(loop.tickTimePercentile(0.9))
+            << ", p99 " << showMillis(loop.tickTimePercentile(0.99))
+            << ", max " << showMillis(loop.tickTimePercentile(1)) << "\n";
+  // the whole loop: ticks, and the packets handled between them
+  std::cout << "server thread allocations: " << allocations << " ("
+            << (loop.ticks ? allocations / loop.ticks : 0)
+            << " per tick, packet handling included)\n";
+
+  std::vector<TimeDiff> echoes;
+  Kbps incoming = 0, outgoing = 0;
+  unsigned long lostEchoes = 0, packetsIn = 0, packetsOut = 0;
+  for (const auto &bot : bots) {
+    const auto &stats = bot->stats;
+    echoes.insert(echoes.end(),
+                  stats.echoLatencies.begin(), stats.echoLatencies.end());
+    lostEchoes += stats.lostEchoes;
+    packetsIn += stats.packetsIn;
+    packetsOut += stats.packetsOut;
+    if (stats.bandwidthSamples) {
+      incoming += stats.incomingTotal / stats.bandwidthSamples;
+      outgoing += stats.outgoingTotal / stats.bandwidthSamples;
+    }
+  }
+
+  std::cout << "per client: " << (incoming / botCount) << " kB/s down, "
+            << (outgoing / botCount) << " kB/s up, "
+            << (packetsIn / botCount) << " packets in, "
+            << (packetsOut / botCount) << " packets out\n";
+  std::cout << "input echo: p50 " << showMillis(percentile(echoes, 0.5))
+            << ", p90 " << showMillis(percentile(echoes, 0.9))
+            << ", p99 " << showMillis(percentile(echoes, 0.99))
+            << " (" << echoes.size() << " samples, "
+            << lostEchoes << " lost)\n";
+}
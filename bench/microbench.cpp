@@ -0,0 +1,359 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Microbenchmarks for engine hot paths, on Google Benchmark.
+ *
+ * Results go to stdout as JSON unless another --benchmark_format is given,
+ * so runs can be kept and compared between commits (e.g. with benchmark's
+ * tools/compare.py).
+ */
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstring>
+#include "engine/protocol.hpp"
+#include "engine/scoreboard.hpp"
+#include "engine/sky/sky.hpp"
+#include "util/telegraph.hpp"
+#include <cereal/archives/json.hpp> // after types.hpp, for its optional rules
+
+namespace {
+
+/**
+ * An arena with a running Sky: `planes` spawned players with their
+ * throttle open, each with `props` props in flight.
+ */
+struct BenchSky {
+  sky::Arena arena;
+  sky::Map map;
+  sky::Sky sky;
+  const int planes, props;
+
+  BenchSky(const int planes, const int props) :
+      arena(sky::ArenaInit("bench", "NULL", sky::ArenaMode::Game)),
+      map(),
+      sky(arena, map, sky::SkyInit()),
+      planes(planes),
+      props(props) {
+    for (int i = 0; i < planes; i++) arena.connectPlayer("bot");
+    reset();
+  }
+
+  // Put every plane and prop back where it started; left alone, planes fly
+  // into the walls and props expire.
+  void reset() {
+    const auto &dims = map.getDimensions();
+    for (int i = 0; i < planes; i++) {
+      sky::Player &player = *arena.getPlayer(PID(i));
+      auto &participation = sky.getParticipation(player);
+      participation.suicide();
+      participation.props.clear();
+
+      player.spawn({}, {dims.x * (i + 1) / (planes + 1), dims.y / 2}, 0);
+      player.doAction(sky::Action::Thrust, true);
+      for (int j = 0; j < props; j++) {
+        participation.spawnProp(sky::PropInit(
+            {dims.x * (i + 1) / (planes + 1), dims.y / 4}, {0, 100.0f * j}));
+      }
+    }
+  }
+
+};
+
+// Ticks a benchmark runs a BenchSky for before resetting it.
+const unsigned int resetInterval = 60;
+
+const int planeCounts[] = {1, 8, 32};
+
+void planeArgs(benchmark::internal::Benchmark *b) {
+  for (const int planes : planeCounts) b->Arg(planes);
+}
+
+/**
+ * Sky.
+ */
+
+void BM_SkyTick(benchmark::State &state) {
+  BenchSky bench(int(state.range(0)), int(state.range(1)));
+  unsigned int ticks = 0;
+  while (state.KeepRunning()) {
+    if (++ticks % resetInterval == 0) {
+      state.PauseTiming();
+      bench.reset();
+      state.ResumeTiming();
+    }
+    bench.arena.tick(1.0f / 60.0f);
+  }
+}
+BENCHMARK(BM_SkyTick)->ArgPair(1, 0)->ArgPair(8, 0)->ArgPair(8, 8)
+    ->ArgPair(32, 0)->ArgPair(32, 8);
+
+void BM_SkyCollectDelta(benchmark::State &state) {
+  BenchSky bench(int(state.range(0)), 0);
+  unsigned int ticks = 0;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    if (++ticks % resetInterval == 0) {
+      bench.reset();
+      bench.sky.collectDelta(); // the spawns
+    }
+    bench.arena.tick(1.0f / 60.0f); // so there's something to collect
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(bench.sky.collectDelta());
+  }
+}
+BENCHMARK(BM_SkyCollectDelta)->Apply(planeArgs);
+
+// Encoded size of a flying plane's deltas over whole keyframe intervals,
+// next to sending its whole state each time.
+void BM_SkyDeltaSize(benchmark::State &state) {
+  BenchSky bench(1, 0);
+  const sky::Player &player = *bench.arena.getPlayer(0);
+  const sky::Participation &participation = bench.sky.getParticipation(player);
+  tg::Telegraph<sky::ClientPacket> telegraph;
+  telegraph.setPackingBounds(bench.sky.getMap().getDimensions());
+  bench.sky.collectDelta(); // the spawn
+
+  size_t deltaBytes = 0, stateBytes = 0, deltas = 0;
+  while (state.KeepRunning()) {
+    bench.arena.tick(1.0f / 60.0f);
+    bench.arena.tick(1.0f / 60.0f); // about the server's delta period
+    const auto delta = bench.sky.collectDelta();
+    deltaBytes += telegraph.outputToString(
+        sky::ServerPacket::DeltaSky(delta, 1)).size();
+
+    auto whole = delta;
+    auto &wholeParticipation = whole.participations.at(player.pid);
+    wholeParticipation.stateDelta.reset();
+    wholeParticipation.state = participation.plane->getState();
+    stateBytes += telegraph.outputToString(
+        sky::ServerPacket::DeltaSky(whole, 1)).size();
+    deltas++;
+  }
+  state.counters["delta_bytes"] = double(deltaBytes) / deltas;
+  state.counters["whole_state_bytes"] = double(stateBytes) / deltas;
+}
+BENCHMARK(BM_SkyDeltaSize)->Iterations(10 * sky::Sky::keyframeInterval);
+
+void BM_SkyDeltaRespectAuthority(benchmark::State &state) {
+  BenchSky bench(int(state.range(0)), 0);
+  bench.arena.tick(1.0f / 60.0f);
+  const sky::SkyDelta delta = bench.sky.collectDelta();
+  const sky::Player &player = *bench.arena.getPlayer(0);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(delta.respectAuthority(player));
+  }
+}
+BENCHMARK(BM_SkyDeltaRespectAuthority)->Apply(planeArgs);
+
+/**
+ * Telegraph, for a representative packet of each ServerPacket::Type.
+ */
+
+sky::ServerPacket samplePacket(const sky::ServerPacket::Type type,
+                               BenchSky &bench) {
+  using Type = sky::ServerPacket::Type;
+  switch (type) {
+    case Type::Ping:
+      return sky::ServerPacket::Ping(1);
+    case Type::Init:
+      return sky::ServerPacket::Init(
+          0, bench.arena.captureInitializer(), std::string("NULL"),
+          sky::ScoreboardInit({"kills", "deaths"}));
+    case Type::InitSky:
+      return sky::ServerPacket::InitSky(bench.sky.captureInitializer());
+    case Type::DeltaArena:
+      return sky::ServerPacket::DeltaArena(
+          sky::ArenaDelta::Motd("benchmarking"));
+    case Type::DeltaSkyHandle:
+      return sky::ServerPacket::DeltaSkyHandle(std::string("NULL"));
+    case Type::DeltaSky: {
+      bench.arena.tick(1.0f / 60.0f);
+      return sky::ServerPacket::DeltaSky(bench.sky.collectDelta(), 1);
+    }
+    case Type::SkyInterest: {
+      // a handful of planes coming and going
+      return sky::ServerPacket::SkyInterest({1, 4, 9, 12}, {2, 7});
+    }
+    case Type::SpawnProps: {
+      // everyone firing at once
+      bench.arena.forPlayers([&](const sky::Player &player) {
+        bench.sky.getParticipation(player).spawnProp(
+            sky::PropInit({100, 100}, {0, 100}));
+      });
+      return sky::ServerPacket::SpawnProps(bench.sky.collectPropSpawns(), 1);
+    }
+    case Type::DeltaScore: {
+      sky::ScoreboardDelta delta;
+      bench.arena.forPlayers([&](const sky::Player &player) {
+        delta.deltas.emplace(player.pid, sky::ScoreRecordDelta{1, 0});
+      });
+      return sky::ServerPacket::DeltaScore(delta);
+    }
+    case Type::Chat:
+      return sky::ServerPacket::Chat(0, "a chat message of typical length");
+    case Type::Broadcast:
+      return sky::ServerPacket::Broadcast("a broadcast of typical length");
+    case Type::RCon:
+      return sky::ServerPacket::RCon("you're authenticated");
+    case Type::Redirect:
+      return sky::ServerPacket::Redirect("other arena", 4243);
+  }
+  throw std::logic_error("unknown ServerPacket::Type");
+}
+
+void BM_TelegraphOutput(benchmark::State &state,
+                        const sky::ServerPacket::Type type) {
+  BenchSky bench(16, 0);
+  const sky::ServerPacket packet = samplePacket(type, bench);
+  tg::Telegraph<sky::ClientPacket> telegraph;
+  telegraph.setPackingBounds(bench.sky.getMap().getDimensions());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(telegraph.outputToString(packet));
+  }
+}
+
+void BM_TelegraphReceive(benchmark::State &state,
+                         const sky::ServerPacket::Type type) {
+  BenchSky bench(16, 0);
+  tg::Telegraph<sky::ServerPacket> telegraph;
+  telegraph.setPackingBounds(bench.sky.getMap().getDimensions());
+  const std::string data =
+      telegraph.outputToString(samplePacket(type, bench));
+
+  ENetPacket packet;
+  std::memset(&packet, 0, sizeof(packet));
+  packet.data = (enet_uint8 *) data.data();
+  packet.dataLength = data.size();
+
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(telegraph.receive(&packet));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+#define TELEGRAPH_BENCHMARKS(type) \
+  BENCHMARK_CAPTURE(BM_TelegraphOutput, type, sky::ServerPacket::Type::type); \
+  BENCHMARK_CAPTURE(BM_TelegraphReceive, type, sky::ServerPacket::Type::type)
+
+TELEGRAPH_BENCHMARKS(Ping);
+TELEGRAPH_BENCHMARKS(Init);
+TELEGRAPH_BENCHMARKS(InitSky);
+TELEGRAPH_BENCHMARKS(DeltaArena);
+TELEGRAPH_BENCHMARKS(DeltaSkyHandle);
+TELEGRAPH_BENCHMARKS(DeltaSky);
+TELEGRAPH_BENCHMARKS(SkyInterest);
+TELEGRAPH_BENCHMARKS(SpawnProps);
+TELEGRAPH_BENCHMARKS(DeltaScore);
+TELEGRAPH_BENCHMARKS(Chat);
+TELEGRAPH_BENCHMARKS(Broadcast);
+TELEGRAPH_BENCHMARKS(RCon);
+TELEGRAPH_BENCHMARKS(Redirect);
+
+/**
+ * Map.
+ */
+
+// A star-shaped (so non-convex) obstacle.
+std::vector<sf::Vector2f> starVertices(const int points) {
+  std::vector<sf::Vector2f> vertices;
+  for (int i = 0; i < 2 * points; i++) {
+    const float radius = (i % 2) ? 20 : 50;
+    const float angle = float(M_PI) * i / points;
+    vertices.emplace_back(radius * std::cos(angle), radius * std::sin(angle));
+  }
+  return vertices;
+}
+
+// Map source, in the format Map::load reads.
+std::string mapSource(const int obstacleCount) {
+  std::vector<sky::MapObstacle> obstacles;
+  for (int i = 0; i < obstacleCount; i++) {
+    obstacles.emplace_back(sf::Vector2f(100.0f * (i % 30), 100.0f * (i / 30)),
+                           starVertices(8), 0);
+  }
+
+  std::stringstream stream;
+  {
+    cereal::JSONOutputArchive ar(stream);
+    ar(cereal::make_nvp("dimensions", sf::Vector2f(3200, 900)),
+       cereal::make_nvp("obstacles", obstacles),
+       cereal::make_nvp("spawnPoints", std::vector<sky::SpawnPoint>()));
+  }
+  return stream.str();
+}
+
+void BM_MapLoad(benchmark::State &state) {
+  const std::string source = mapSource(int(state.range(0)));
+  while (state.KeepRunning()) {
+    std::istringstream stream(source);
+    benchmark::DoNotOptimize(sky::Map::load(stream));
+  }
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_MapLoad)->Arg(10)->Arg(100)->Unit(benchmark::kMicrosecond);
+
+void BM_MapObstacleDecompose(benchmark::State &state) {
+  sky::MapObstacle obstacle({}, starVertices(int(state.range(0))), 0);
+  while (state.KeepRunning()) {
+    obstacle.decompose();
+    benchmark::DoNotOptimize(obstacle.decomposed);
+  }
+}
+BENCHMARK(BM_MapObstacleDecompose)->Arg(4)->Arg(16)->Arg(64);
+
+/**
+ * Arena.
+ */
+
+void BM_ArenaApplyDelta(benchmark::State &state) {
+  sky::Arena arena(sky::ArenaInit("bench", "NULL", sky::ArenaMode::Game));
+  for (int i = 0; i < state.range(0); i++)
+    arena.connectPlayer("player");
+
+  // The shape of LatencyTracker's periodic update.
+  std::map<PID, sky::PlayerDelta> deltas;
+  arena.forPlayers([&](sky::Player &player) {
+    sky::PlayerDelta delta{player};
+    delta.latencyStats.emplace(0.05f, 0.0);
+    deltas.emplace(player.pid, delta);
+  });
+  const sky::ArenaDelta delta = sky::ArenaDelta::Delta(deltas);
+
+  while (state.KeepRunning()) {
+    arena.applyDelta(delta);
+  }
+}
+BENCHMARK(BM_ArenaApplyDelta)->Apply(planeArgs);
+
+}
+
+int main(int argc, char **argv) {
+  // Default to JSON output, keeping any format the user asked for.
+  std::vector<char *> args(argv, argv + argc);
+  static char jsonFormat[] = "--benchmark_format=json";
+  bool formatGiven = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--benchmark_format", 18) == 0)
+      formatGiven = true;
+  }
+  if (!formatGiven) args.push_back(jsonFormat);
+
+  int count = int(args.size());
+  benchmark::Initialize(&count, args.data());
+  benchmark::RunSpecifiedBenchmarks();
+}
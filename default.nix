@@ -20,7 +20,7 @@ let
     glew 
     gdb
     udev 
-    p7zip
+    zlib
     boost ]; 
 
 in
@@ -85,6 +85,51 @@ void MultiplayerCore::onEndGame() {
   askedSky = false;
 }
 
+void MultiplayerCore::recordMotion(sky::Sky &sky,
+                                   const sky::SkyDelta &delta,
+                                   const Time timestamp) {
+  for (const auto &participation : delta.participations) {
+    const PID pid = participation.first;
+    const sky::Player *player = conn->arena.getPlayer(pid);
+    if (pid == conn->player.pid or !player) continue;
+
+    const auto &plane = sky.getParticipation(*player).plane;
+    // don't blend across a respawn
+    if (participation.second.spawn or !plane) remoteMotion.erase(pid);
+    if (plane) {
+      remoteMotion.emplace(pid, sky::SnapshotBufferSettings{})
+          .first->second.push(timestamp, plane->getState().physical,
+                              conn->arena.getUptime());
+    }
+  }
+}
+
+void MultiplayerCore::displayMotion(sky::Sky &sky) {
+  // we need to know where the server's clock is
+  if (!conn->player.latencyIsCalculated()) return;
+
+  auto iter = remoteMotion.begin();
+  while (iter != remoteMotion.end()) {
+    const sky::Player *player = conn->arena.getPlayer(iter->first);
+    if (!player or !sky.getParticipation(*player).isSpawned()) {
+      iter = remoteMotion.erase(iter);
+      continue;
+    }
+
+    if (const auto physical = iter->second.sample(
+        conn->arena.getUptime(), conn->player.getClockOffset()))
+      sky.getParticipation(*player).displayPhysical(*physical);
+    ++iter;
+  }
+}
+
+optional<TimeDiff> MultiplayerCore::getViewDelay() const {
+  if (remoteMotion.empty()) return {};
+  TimeDiff total = 0;
+  for (const auto &motion : remoteMotion) total += motion.second.getDelay();
+  return total / remoteMotion.size();
+}
+
 void MultiplayerCore::processPacket(const sky::ServerPacket &packet) {
   using namespace sky;
 
@@ -106,13 +151,26 @@ void MultiplayerCore::processPacket(const sky::ServerPacket &packet) {
           conn->arena.getName(),
           tg::printAddress(host.getPeers()[0]->address)));
     }
+
+    if (packet.type == ServerPacket::Type::Redirect and !redirectPort) {
+      // the arena we asked for lives on another port
+      appLog("Redirected to arena " + inQuotes(packet.stringData.get())
+                 + " on port " + std::to_string(packet.port.get()) + "...",
+             LogOrigin::Client);
+      redirectPort = packet.port.get();
+      host.disconnect(server);
+    }
     return;
   }
 
   // we're in the arena, conn is instantiated
   switch (packet.type) {
     case ServerPacket::Type::InitSky: {
+      // sky packets, both ways, are packed against its map from now on
+      telegraph.setPackingBounds(packet.skyInit->dimensions);
       conn->skyHandle.instantiateSky(packet.skyInit.get());
+      lastSkyDelta.reset();
+      remoteMotion.clear();
       break;
     }
 
@@ -133,8 +191,29 @@ void MultiplayerCore::processPacket(const sky::ServerPacket &packet) {
     }
 
     case ServerPacket::Type::DeltaSky: {
+      const auto &skyDelta = packet.skyDelta.get();
+      const Time timestamp = packet.timestamp.get();
+
+      // Snapshots travel unreliably on their own channel, and can overtake
+      // or trail the reliable deltas; drop those older than what we have.
+      // A late reliable delta still carries keyframes newer snapshots are
+      // relative to.
+      const bool late = lastSkyDelta and timestamp < *lastSkyDelta;
+      if (!skyDelta.needsReliable()) {
+        if (late) break;
+        if (!conn->skyHandle.getSky()) break;
+      }
+
       if (const auto sky = conn->skyHandle.getSky()) {
-        sky->applyDelta(packet.skyDelta.get());
+        // The server broadcasts one delta to everyone; we have authority
+        // over parts of our own participation.
+        if (late) {
+          sky->applyLateDelta(skyDelta.respectAuthority(conn->player));
+          break;
+        }
+        sky->applyDelta(skyDelta.respectAuthority(conn->player), timestamp);
+        recordMotion(*sky, skyDelta, timestamp);
+        lastSkyDelta = timestamp;
       } else {
         appLog("Received sky delta packet before sky was initialized! "
                    "This should NEVER happen!", LogOrigin::Error);
@@ -142,6 +221,20 @@ void MultiplayerCore::processPacket(const sky::ServerPacket &packet) {
       break;
     }
 
+    case ServerPacket::Type::SpawnProps: {
+      if (const auto sky = conn->skyHandle.getSky())
+        sky->applyPropSpawns(packet.propSpawns.get(),
+                             packet.timestamp.get());
+      break;
+    }
+
+    case ServerPacket::Type::SkyInterest: {
+      // Their snapshots come at another rate now; buffer them afresh.
+      for (const PID pid : packet.entered.get()) remoteMotion.erase(pid);
+      for (const PID pid : packet.left.get()) remoteMotion.erase(pid);
+      break;
+    }
+
     case ServerPacket::Type::DeltaScore: {
       conn->scoreboard.applyDelta(packet.scoreDelta.get());
       break;
@@ -179,6 +272,12 @@ bool MultiplayerCore::pollNetwork() {
 
   if (event.type == ENET_EVENT_TYPE_DISCONNECT) {
     server = nullptr;
+    if (redirectPort) {
+      host.connect(serverHostname, *redirectPort);
+      redirectPort.reset();
+      askedConnection = false;
+      return false;
+    }
     appLog("Disconnected from server!", LogOrigin::Client);
     disconnected = true;
     return true;
@@ -204,10 +303,13 @@ MultiplayerCore::MultiplayerCore(
     ClientShared &shared,
     ConnectionObserver &listener,
     const std::string &serverHostname,
-    const unsigned short serverPort) :
+    const unsigned short serverPort,
+    const optional<std::string> &arenaName) :
     ClientComponent(shared),
 
     observer(listener),
+    serverHostname(serverHostname),
+    arenaName(arenaName),
     askedConnection(false),
     askedSky(false),
     disconnectTimeout(1),
@@ -259,8 +361,9 @@ void MultiplayerCore::onChangeSettings(const ui::SettingsDelta &settings) {
   }
 }
 
-void MultiplayerCore::transmit(const sky::ClientPacket &packet) {
-  if (server) telegraph.transmit(host, server, packet);
+void MultiplayerCore::transmit(const sky::ClientPacket &packet,
+                               const tg::Channel channel) {
+  if (server) telegraph.transmit(host, server, packet, channel);
 }
 
 void MultiplayerCore::disconnect() {
@@ -279,7 +382,8 @@ bool MultiplayerCore::poll() {
   if (server && !askedConnection) {
     // we have a link but haven't sent an arena connection request
     appLog("Asking to join arena...", LogOrigin::Client);
-    transmit(sky::ClientPacket::ReqJoin(shared.references.settings.nickname));
+    transmit(sky::ClientPacket::ReqJoin(
+        shared.references.settings.nickname, arenaName));
     askedConnection = true;
   }
 
@@ -291,13 +395,16 @@ void MultiplayerCore::tick(const float delta) {
   host.tick(delta);;
   if (conn) {
     conn->arena.tick(delta);
+    if (const auto sky = conn->skyHandle.getSky()) displayMotion(*sky);
 
     // Sending scheduled participation inputs.
     if (const auto &sky = conn->skyHandle.getSky()) {
       if (participationInputTimer.cool(delta)) {
-        const auto input = sky->getParticipation(conn->player).collectInput();
+        auto input = sky->getParticipation(conn->player).collectInput();
         if (input) {
-          transmit(sky::ClientPacket::ReqInput(input.get()));
+          input->viewDelay = getViewDelay();
+          transmit(sky::ClientPacket::ReqInput(input.get()),
+                   tg::Channel::Snapshot);
           participationInputTimer.reset();
         }
       }
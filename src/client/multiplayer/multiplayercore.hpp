@@ -25,6 +25,7 @@
 #include "engine/event.hpp"
 #include "engine/protocol.hpp"
 #include "engine/debugview.hpp"
+#include "engine/flowcontrol.hpp"
 #include "client/elements/elements.hpp"
 #include "client/elements/clientui.hpp"
 
@@ -113,9 +114,15 @@ class MultiplayerCore: public ClientComponent {
   // Connection state.
   optional<MultiplayerLogger> proxyLogger;
   optional<MultiplayerSubsystem> proxySubsystem;
+  const std::string serverHostname;
+  const optional<std::string> arenaName; // arena to ask for, if any
+  optional<Port> redirectPort; // reconnecting to another port of the server
   bool askedConnection;
   bool askedSky;
   Cooldown disconnectTimeout;
+  optional<Time> lastSkyDelta; // timestamp of the newest sky delta applied
+  // Other players' planes, shown between the server's snapshots.
+  std::map<PID, sky::SnapshotBuffer<sky::PhysicalState>> remoteMotion;
 
   tg::Telegraph<sky::ServerPacket> telegraph;
   tg::Host host;
@@ -132,6 +139,12 @@ class MultiplayerCore: public ClientComponent {
 
   // Packet processing submethod.
   void processPacket(const sky::ServerPacket &packet);
+  // Buffering remote plane motion, and displaying it.
+  void recordMotion(sky::Sky &sky, const sky::SkyDelta &delta,
+                    const Time timestamp);
+  void displayMotion(sky::Sky &sky);
+  // How far behind the server's clock we show other planes, on average.
+  optional<TimeDiff> getViewDelay() const;
   // (returns true when the queue has been exhausted)
   bool pollNetwork();
 
@@ -140,7 +153,8 @@ class MultiplayerCore: public ClientComponent {
       ClientShared &shared,
       ConnectionObserver &listener,
       const std::string &serverHostname,
-      const unsigned short serverPort);
+      const unsigned short serverPort,
+      const optional<std::string> &arenaName = {});
   ~MultiplayerCore();
 
   // MessageInteraction and printers.
@@ -160,7 +174,8 @@ class MultiplayerCore: public ClientComponent {
   void onChangeSettings(const ui::SettingsDelta &settings);
 
   // User API.
-  void transmit(const sky::ClientPacket &packet);
+  void transmit(const sky::ClientPacket &packet,
+                const tg::Channel channel = tg::Channel::Reliable);
   void disconnect();
   bool poll();
   void tick(const TimeDiff delta);
@@ -239,7 +239,7 @@ bool Sandbox::handle(const sf::Event &event) {
       if (action.first == ui::ClientAction::Spawn
           and action.second
           and !participation.isSpawned()) {
-        const auto spawnPoint = sky->getMap().pickSpawnPoint(sky::Team::Spectator);
+        const auto spawnPoint = sky->pickSpawnPoint(*player);
         player->spawn(spawnTuning, spawnPoint.pos, spawnPoint.angle);
         return true;
       }
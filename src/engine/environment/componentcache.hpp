@@ -0,0 +1,123 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Process-wide cache of loaded environment components.
+ */
+#pragma once
+#include <functional>
+#include <map>
+#include <memory>
+#include "util/threads.hpp"
+
+namespace sky {
+
+/**
+ * Loaded components (Map, Visuals, Mechanics) by the content they were
+ * loaded from, so Environments that share a file -- arenas on the same map,
+ * or the same map coming round again -- load it once and share the result.
+ * The most recently used few stay cached even when nobody holds them.
+ *
+ * Safe to use from several loading threads: when a key is already being
+ * loaded, get() waits for that load rather than starting another.
+ */
+template<typename Component, typename Key>
+class ComponentCache {
+ public:
+  using Loader = std::function<std::shared_ptr<const Component>()>;
+
+ private:
+  struct Entry {
+    std::shared_ptr<const Component> component;
+    bool loading;
+    unsigned long lastUse;
+  };
+
+  std::mutex mutex;
+  std::condition_variable loadFinished;
+  std::map<Key, Entry> entries;
+  unsigned long uses;
+  const size_t capacity;
+
+  // Drop the least recently used entries, beyond capacity.
+  void evict() {
+    while (entries.size() > capacity) {
+      auto oldest = entries.end();
+      for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+        if (!iter->second.loading and (oldest == entries.end()
+            or iter->second.lastUse < oldest->second.lastUse))
+          oldest = iter;
+      }
+      if (oldest == entries.end()) return;
+      entries.erase(oldest);
+    }
+  }
+
+ public:
+  ComponentCache(const size_t capacity) :
+      uses(0), capacity(capacity) {}
+
+  /**
+   * The component for a key, loading it if we must. nullptr if loading
+   * failed; failures aren't cached.
+   */
+  std::shared_ptr<const Component> get(const Key &key,
+                                       const Loader &load) {
+    std::unique_lock<std::mutex> lock(mutex);
+    loadFinished.wait(lock, [&]() {
+      const auto iter = entries.find(key);
+      return iter == entries.end() or !iter->second.loading;
+    });
+
+    const auto iter = entries.find(key);
+    if (iter != entries.end()) {
+      iter->second.lastUse = ++uses;
+      return iter->second.component;
+    }
+
+    entries[key] = Entry{nullptr, true, ++uses};
+    lock.unlock();
+    std::shared_ptr<const Component> component;
+    try {
+      component = load();
+    } catch (...) {
+      lock.lock();
+      entries.erase(key);
+      loadFinished.notify_all();
+      throw;
+    }
+    lock.lock();
+
+    if (component) {
+      auto &entry = entries[key];
+      entry.component = component;
+      entry.loading = false;
+      evict();
+    } else entries.erase(key);
+
+    loadFinished.notify_all();
+    return component;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+  }
+
+};
+
+}
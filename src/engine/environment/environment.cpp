@@ -15,14 +15,156 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <sstream>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/uuid/name_generator_sha1.hpp>
+#include <boost/uuid/uuid_io.hpp>
 #include <util/methods.hpp>
 #include "util/printer.hpp"
 #include "util/methods.hpp"
 #include "environment.hpp"
+#include "componentcache.hpp"
 
 namespace sky {
 
+/**
+ * Component caches, shared by every Environment in the process.
+ */
+
+namespace {
+
+using ContentKey = boost::uuids::uuid;
+
+ComponentCache<Map, ContentKey> mapCache(8);
+ComponentCache<Visuals, ContentKey> visualsCache(8);
+ComponentCache<Mechanics, ContentKey> mechanicsCache(8);
+
+// Loading jobs for every Environment in the process.
+WorkerPool &loaderPool() {
+  static WorkerPool pool(
+      std::max(2u, std::thread::hardware_concurrency() / 2));
+  return pool;
+}
+
+// The bytes of an archive entry: viewed in place when it's stored
+// uncompressed, inflated otherwise.
+struct EntryBytes {
+  optional<ArchiveView> view;
+  optional<std::string> contents;
+
+  const unsigned char *data() const {
+    return view ? view->data : (const unsigned char *) contents->data();
+  }
+
+  size_t size() const {
+    return view ? view->size : contents->size();
+  }
+};
+
+optional<EntryBytes> readEntry(const Archive &archive,
+                               const ArchiveEntry &file) {
+  EntryBytes bytes;
+  bytes.view = archive.viewFile(file.path);
+  if (!bytes.view) {
+    bytes.contents = archive.readFile(file.path);
+    if (!bytes.contents) return {};
+  }
+  return bytes;
+}
+
+// Content address of a file: a SHA-1 name-based UUID of its bytes, in a
+// namespace named by its environment's URL.
+ContentKey contentKey(const EnvironmentURL &url, const EntryBytes &bytes) {
+  using namespace boost::uuids;
+  const uuid environment = name_generator_sha1(ns::url())(url);
+  return name_generator_sha1(environment)(bytes.data(), bytes.size());
+}
+
+/**
+ * Maps: a binary map is read straight out of the archive when it's stored
+ * uncompressed. A JSON map is parsed once, then kept as a binary map in
+ * the on-disk cache, which we memory-map.
+ */
+
+// Heads a cached map: what it was made from, checked before we trust it.
+struct CachedMapHeader {
+  ContentKey source;
+  uint64_t sourceSize;
+};
+
+fs::path mapCachePath(const ContentKey &key) {
+  return getCachePath("maps/" + boost::uuids::to_string(key) + ".bin");
+}
+
+optional<Map> loadCachedMap(const fs::path &path, const ContentKey &key,
+                            const size_t sourceSize,
+                            const ProgressMonitor &monitor) {
+  boost::system::error_code error;
+  if (!fs::is_regular_file(path, error)) return {};
+  try {
+    boost::iostreams::mapped_file_source file(path.string());
+    CachedMapHeader header;
+    if (file.size() < sizeof(header)) return {};
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.source != key or header.sourceSize != sourceSize) {
+      appLog("Cached map " + path.string() + " is of another source; "
+                 "rebuilding it.", LogOrigin::Engine);
+      return {};
+    }
+    return Map::loadBinary(
+        (const unsigned char *) file.data() + sizeof(header),
+        file.size() - sizeof(header), monitor);
+  } catch (const std::exception &e) {
+    appLog("Could not map cached map " + path.string() + ": " + e.what(),
+           LogOrigin::Error);
+    return {};
+  }
+}
+
+void cacheMap(const Map &map, const fs::path &path,
+              const CachedMapHeader &header) {
+  // Written aside and renamed, so nobody maps a half-written file.
+  boost::system::error_code error;
+  fs::create_directories(path.parent_path(), error);
+  const fs::path temporary =
+      fs::unique_path(path.string() + ".%%%%-%%%%", error);
+  if (error) return;
+
+  bool written;
+  {
+    std::ofstream file(temporary.string(), std::ios::binary);
+    file.write((const char *) &header, sizeof(header));
+    map.saveBinary(file);
+    written = bool(file);
+  }
+  if (written) fs::rename(temporary, path, error);
+  if (!written or error) {
+    fs::remove(temporary, error);
+    appLog("Could not write cached map " + path.string(), LogOrigin::Error);
+  }
+}
+
+optional<Map> readMap(const ArchiveEntry &file, const EntryBytes &bytes,
+                      const ContentKey &key, const ProgressMonitor &monitor) {
+  if (file.path == "map.bin")
+    return Map::loadBinary(bytes.data(), bytes.size(), monitor);
+
+  const auto cachePath = mapCachePath(key);
+  if (auto cached = loadCachedMap(cachePath, key, bytes.size(), monitor))
+    return cached;
+
+  std::istringstream stream(
+      std::string((const char *) bytes.data(), bytes.size()));
+  auto loaded = Map::load(stream, monitor);
+  if (loaded) cacheMap(*loaded, cachePath, {key, bytes.size()});
+  return loaded;
+}
+
+}
+
 /**
  * Environment.
  */
@@ -57,69 +199,116 @@ std::string Environment::describeComponentMalformed(const Component c) {
   return "Environment " + describeComponent(c) + " component data appears to be malformed!";
 }
 
-void Environment::loadMap(const fs::path &path) {
+void Environment::startLoading(PoolJob::Work &&work) {
+  loadProgress = 0;
+  loadJob = loaderPool().submit(
+      [this, work = std::move(work)](const PoolJob &job) {
+        work(job);
+        if (job.isCancelled()) {
+          appLog("Environment loading was cancelled.", LogOrigin::Engine);
+          loadError = true;
+        } else loadProgress = 1;
+      });
+}
+
+ProgressMonitor Environment::monitorStage(const PoolJob &job,
+                                          const float from, const float to) {
+  return [this, &job, from, to](const float progress) {
+    loadProgress = from + (to - from) * progress;
+    return !job.isCancelled();
+  };
+}
+
+void Environment::loadMap(const ArchiveEntry &file, const PoolJob &job) {
   appLog(describeComponentLoading(Component::Map), LogOrigin::Engine);
-  std::ifstream mapFile(path.string());
-  if (auto map = Map::load(mapFile)) {
-    this->map.emplace(std::move(map.get()));
-  } else {
+  const auto monitor = monitorStage(job, 0.5f, 1);
+  if (const auto bytes = readEntry(fileArchive, file)) {
+    const auto key = contentKey(url, *bytes);
+    map = mapCache.get(key, [&]() -> std::shared_ptr<const Map> {
+      if (auto loaded = readMap(file, *bytes, key, monitor))
+        return std::make_shared<const Map>(std::move(loaded.get()));
+      return nullptr;
+    });
+  }
+
+  if (!map) {
+    if (job.isCancelled()) return;
     appLog(describeComponentMalformed(Component::Map), LogOrigin::Error);
     loadError = true;
+    return;
   }
   appLog(describeComponentDone(Component::Map), LogOrigin::Engine);
 }
 
-void Environment::loadMechanics(const fs::path &path) {
+void Environment::loadMechanics(const ArchiveEntry &file) {
   appLog(describeComponentLoading(Component::Mechanics), LogOrigin::Engine);
-  mechanics.emplace();
+  const auto bytes = readEntry(fileArchive, file);
+  if (!bytes) {
+    appLog(describeComponentMalformed(Component::Mechanics), LogOrigin::Error);
+    loadError = true;
+    return;
+  }
+  mechanics = mechanicsCache.get(contentKey(url, *bytes), []() {
+    return std::make_shared<const Mechanics>();
+  });
   appLog(describeComponentDone(Component::Mechanics), LogOrigin::Engine);
 }
 
-void Environment::loadVisuals(const fs::path &path) {
+void Environment::loadVisuals(const ArchiveEntry &file) {
   appLog(describeComponentLoading(Component::Visuals), LogOrigin::Engine);
-  visuals.emplace();
+  const auto bytes = readEntry(fileArchive, file);
+  if (!bytes) {
+    appLog(describeComponentMalformed(Component::Visuals), LogOrigin::Error);
+    loadError = true;
+    return;
+  }
+  visuals = visualsCache.get(contentKey(url, *bytes), []() {
+    return std::make_shared<const Visuals>();
+  });
   appLog(describeComponentDone(Component::Visuals), LogOrigin::Engine);
 }
 
 void Environment::loadNullMap() {
   appLog(describeComponentLoadingNull(Component::Map), LogOrigin::Engine);
-  map.emplace();
+  map = std::make_shared<const Map>();
   appLog(describeComponentDone(Component::Map), LogOrigin::Engine);
 }
 
 void Environment::loadNullMechanics() {
   appLog(describeComponentLoadingNull(Component::Mechanics), LogOrigin::Engine);
-  mechanics.emplace();
+  mechanics = std::make_shared<const Mechanics>();
   appLog(describeComponentDone(Component::Mechanics), LogOrigin::Engine);
 }
 
 void Environment::loadNullVisuals() {
   appLog(describeComponentLoadingNull(Component::Visuals), LogOrigin::Engine);
-  visuals.emplace();
+  visuals = std::make_shared<const Visuals>();
   appLog(describeComponentDone(Component::Visuals), LogOrigin::Engine);
 }
 
 Environment::Environment(const EnvironmentURL &url) :
     archivePath(fs::system_complete(getEnvironmentPath(url + ".sky"))),
     fileArchive(archivePath),
-    workerRunning(false),
     loadError(false),
     loadProgress(0),
     url(url) {
   if (url == "NULL") {
     appLog("Creating null environment.", LogOrigin::Engine);
-    workerThread = std::thread([&]() { loadNullMap(); });
+    startLoading([this](const PoolJob &) { loadNullMap(); });
   } else {
     appLog("Creating environment " + inQuotes(url)
                + " with environment file " + archivePath.string(),
            LogOrigin::Engine);
 
-    workerRunning = true;
-    workerThread = std::thread([&]() {
-      fileArchive.load();
-      if (const auto dir = fileArchive.getResult()) {
-        if (const auto mapPath = dir->getTopFile("map.json")) {
-          loadMap(mapPath.get());
+    startLoading([this](const PoolJob &job) {
+      fileArchive.load(monitorStage(job, 0, 0.5f));
+      if (job.isCancelled()) return;
+
+      if (fileArchive.isOpen()) {
+        const ArchiveEntry *mapFile = fileArchive.getEntry("map.bin");
+        if (!mapFile) mapFile = fileArchive.getEntry("map.json");
+        if (mapFile) {
+          loadMap(*mapFile, job);
         } else {
           appLog(describeComponentMissing(Component::Map), LogOrigin::Error);
           loadError = true;
@@ -129,8 +318,6 @@ Environment::Environment(const EnvironmentURL &url) :
                    + archivePath.string(), LogOrigin::Error);
         loadError = true;
       }
-
-      workerRunning = false;
     });
   }
 }
@@ -139,30 +326,29 @@ Environment::Environment() :
     Environment("NULL") {}
 
 Environment::~Environment() {
-  joinWorker();
+  if (loadJob) {
+    loadJob->cancel();
+    loadJob->wait();
+  }
 }
 
 void Environment::loadMore(
     const bool needVisuals, const bool needMechanics) {
   if (loadingIdle()) {
-    joinWorker();
     assert(!loadError);
     assert(imply(needVisuals, !visuals));
     assert(imply(needMechanics, !mechanics));
 
     appLog("Beginning secondary environment loading.", LogOrigin::Engine);
 
-    workerRunning = true;
-    workerThread = std::thread([&, needVisuals, needMechanics]() {
+    startLoading([this, needVisuals, needMechanics](const PoolJob &job) {
       if (url == "NULL") {
         if (needVisuals) loadNullVisuals();
         if (needMechanics) loadNullMechanics();
       } else {
-        const auto dir = *this->fileArchive.getResult();
-
         if (needVisuals) {
-          if (const auto visualFile = dir.getTopFile("graphics.json")) {
-            loadVisuals(visualFile.get());
+          if (const auto visualFile = fileArchive.getEntry("graphics.json")) {
+            loadVisuals(*visualFile);
           } else {
             appLog(describeComponentMissing(Component::Visuals),
                    LogOrigin::Error);
@@ -171,8 +357,11 @@ void Environment::loadMore(
         }
 
         if (needMechanics) {
-          if (const auto mechanicsFile = dir.getTopFile("mechanics.json")) {
-            loadMechanics(mechanicsFile.get());
+          if (needVisuals) loadProgress = 0.5f;
+          if (job.isCancelled()) return;
+          if (const auto mechanicsFile =
+              fileArchive.getEntry("mechanics.json")) {
+            loadMechanics(*mechanicsFile);
           } else {
             appLog(describeComponentMissing(Component::Mechanics),
                    LogOrigin::Error);
@@ -180,8 +369,6 @@ void Environment::loadMore(
           }
         }
       }
-
-      workerRunning = false;
     });
   } else {
     appLog("Tried to start secondary loading before primary loading finished.", LogOrigin::Error);
@@ -189,8 +376,7 @@ void Environment::loadMore(
 }
 
 void Environment::joinWorker() {
-  if (workerThread.joinable())
-    workerThread.join();
+  if (loadJob) loadJob->wait();
 }
 
 bool Environment::loadingErrored() const {
@@ -198,7 +384,7 @@ bool Environment::loadingErrored() const {
 }
 
 bool Environment::loadingIdle() const {
-  return !workerRunning;
+  return !loadJob or loadJob->isFinished();
 }
 
 float Environment::loadingProgress() const {
@@ -206,15 +392,15 @@ float Environment::loadingProgress() const {
 }
 
 Map const *Environment::getMap() const {
-  return map.get_ptr();
+  return map.get();
 }
 
 Visuals const *Environment::getVisuals() const {
-  return visuals.get_ptr();
+  return visuals.get();
 }
 
 Mechanics const *Environment::getMechanics() const {
-  return mechanics.get_ptr();
+  return mechanics.get();
 }
 
 }
@@ -24,6 +24,7 @@
 #include "mechanics.hpp"
 #include "map.hpp"
 #include "util/threads.hpp"
+#include "util/workerpool.hpp"
 #include "util/archive.hpp"
 #include "engine/types.hpp"
 
@@ -40,15 +41,20 @@ class Environment {
   fs::path archivePath;
   Archive fileArchive;
 
-  // State.
-  bool workerRunning;
-  bool loadError;
-  float loadProgress;
-  optional<Map> map;
-  optional<Visuals> visuals;
-  optional<Mechanics> mechanics;
+  // State. Loading jobs write the components; we read them once the job
+  // has finished.
+  std::atomic<bool> loadError;
+  std::atomic<float> loadProgress;
+  std::shared_ptr<const Map> map;
+  std::shared_ptr<const Visuals> visuals;
+  std::shared_ptr<const Mechanics> mechanics;
 
-  std::thread workerThread;
+  // Our current job on the loader pool, shared by every Environment.
+  std::shared_ptr<PoolJob> loadJob;
+  void startLoading(PoolJob::Work &&work);
+  // Follows a stage of a job, spanning [from, to] of our progress.
+  ProgressMonitor monitorStage(const PoolJob &job,
+                               const float from, const float to);
 
   // Canonical logging messages.
   enum class Component { Map, Mechanics, Visuals };
@@ -59,10 +65,11 @@ class Environment {
   static std::string describeComponentMissing(const Component c);
   static std::string describeComponentMalformed(const Component c);
 
-  // Loading subroutines -- they expect fileArchive to be loaded.
-  void loadMap(const fs::path &path);
-  void loadMechanics(const fs::path &path);
-  void loadVisuals(const fs::path &path);
+  // Loading subroutines, from files in fileArchive; components come from
+  // the process-wide ComponentCaches when their files were loaded before.
+  void loadMap(const ArchiveEntry &file, const PoolJob &job);
+  void loadMechanics(const ArchiveEntry &file);
+  void loadVisuals(const ArchiveEntry &file);
 
   // Null loading subroutines.
   void loadNullMap();
@@ -74,7 +81,7 @@ class Environment {
   // The null environment, useful for testing and sandboxes.
   // The default ctor is equilivent to supplying a URL of "NULL".
   Environment();
-  ~Environment();
+  ~Environment(); // cancels loading
 
   const EnvironmentURL url;
 
@@ -82,12 +89,13 @@ class Environment {
   void loadMore(const bool needVisuals, const bool needMechanics);
   void joinWorker();
 
-  // Load status.
+  // Load status. Progress is of the current loading stage, in [0, 1].
   bool loadingErrored() const;
   bool loadingIdle() const;
   float loadingProgress() const;
 
-  // Accessing loaded resources. nullptr if they aren't loaded.
+  // Accessing loaded resources. nullptr if they aren't loaded. They may be
+  // shared with other Environments, and never change.
   Map const *getMap() const;
   Visuals const *getVisuals() const;
   Mechanics const *getMechanics() const;
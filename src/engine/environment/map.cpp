@@ -15,7 +15,11 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include <list>
 #include <polypartition.hpp>
 #include "map.hpp"
@@ -24,6 +28,139 @@
 
 namespace sky {
 
+namespace {
+
+// Box2D welds vertices closer than this (in px), so we do it first.
+const float weldDistance = 0.5f;
+
+// Bump this when decompose() changes, to invalidate cached decompositions.
+const uint64_t decompositionVersion = 1;
+
+// FNV-1a.
+const uint64_t hashBasis = 14695981039346656037ull;
+
+uint64_t hashBytes(uint64_t hash, const void *data, const size_t size) {
+  const auto *bytes = (const unsigned char *) data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+float polygonArea(const std::vector<sf::Vector2f> &vertices) {
+  float area = 0;
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const auto &a = vertices[i], &b = vertices[(i + 1) % vertices.size()];
+    area += a.x * b.y - b.x * a.y;
+  }
+  return std::abs(area) / 2;
+}
+
+/**
+ * Turn a convex polygon into fixture-ready pieces: welded, no larger than
+ * MapObstacle::maxPieceVertices, and not degenerate.
+ */
+void addPieces(std::vector<sf::Vector2f> &&polygon,
+               std::vector<std::vector<sf::Vector2f>> &pieces) {
+  std::vector<sf::Vector2f> welded;
+  for (const auto &vertex : polygon) {
+    if (welded.empty()
+        or VecMath::length(vertex - welded.back()) > weldDistance)
+      welded.push_back(vertex);
+  }
+  while (welded.size() > 1
+      and VecMath::length(welded.front() - welded.back()) <= weldDistance)
+    welded.pop_back();
+
+  // Fan out from the first vertex; every piece of a convex fan is convex.
+  const size_t step = MapObstacle::maxPieceVertices - 2;
+  for (size_t i = 1; i + 1 < welded.size(); i += step) {
+    std::vector<sf::Vector2f> piece{welded[0]};
+    const size_t end = std::min(welded.size(), i + step + 1);
+    piece.insert(piece.end(), welded.begin() + i, welded.begin() + end);
+    if (piece.size() >= 3 and polygonArea(piece) > 1)
+      pieces.push_back(std::move(piece));
+  }
+}
+
+/**
+ * Whether a piece we didn't make ourselves is what addPieces() would make:
+ * finite, welded, convex, and neither too large nor degenerate. Box2D asserts
+ * on anything else.
+ */
+bool isFitPiece(const std::vector<sf::Vector2f> &piece) {
+  if (piece.size() < 3 or piece.size() > MapObstacle::maxPieceVertices)
+    return false;
+
+  float turn = 0;
+  for (size_t i = 0; i < piece.size(); i++) {
+    const auto &a = piece[i], &b = piece[(i + 1) % piece.size()],
+        &c = piece[(i + 2) % piece.size()];
+    if (!std::isfinite(a.x) or !std::isfinite(a.y)) return false;
+    if (VecMath::length(b - a) <= weldDistance) return false;
+    const float cross = (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+    if (cross * turn < 0) return false;
+    if (cross != 0) turn = cross;
+  }
+  return polygonArea(piece) > 1;
+}
+
+}
+
+/**
+ * The binary map format: a Header, then the Obstacle, Piece and Spawn
+ * records, then every vertex as a pair of floats. Everything is in little
+ * endian; a big-endian host fails the version check rather than misreading.
+ */
+
+namespace binary {
+
+const char magic[8] = {'S', 'K', 'Y', 'M', 'A', 'P', '\0', '\0'};
+const uint32_t version = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  float width, height;
+  uint32_t obstacles, pieces, spawnPoints, vertices;
+};
+
+struct Obstacle {
+  uint64_t hash; // geometryHash() when the pieces were written
+  float x, y, damage;
+  uint32_t firstVertex, vertexCount;
+  uint32_t firstPiece, pieceCount;
+  uint32_t reserved;
+};
+
+struct Piece {
+  uint32_t firstVertex, vertexCount;
+};
+
+struct Spawn {
+  float x, y, angle;
+  uint32_t team;
+};
+
+// The records are copied in and out whole, so their layout is the format.
+static_assert(sizeof(Header) == 36, "binary::Header is not packed");
+static_assert(sizeof(Obstacle) == 40, "binary::Obstacle is not packed");
+static_assert(sizeof(Piece) == 8, "binary::Piece is not packed");
+static_assert(sizeof(Spawn) == 16, "binary::Spawn is not packed");
+static_assert(sizeof(sf::Vector2f) == 2 * sizeof(float),
+              "sf::Vector2f is not a pair of floats");
+static_assert(std::numeric_limits<float>::is_iec559,
+              "binary maps store IEEE 754 floats");
+
+template<typename Record>
+void write(std::ostream &s, const std::vector<Record> &records) {
+  if (!records.empty())
+    s.write((const char *) records.data(), records.size() * sizeof(Record));
+}
+
+}
+
 /**
  * SpawnPoint.
  */
@@ -37,6 +174,8 @@ SpawnPoint::SpawnPoint() : pos(), angle(0), team(sky::Team::Spectator) {}
 * MapObstacle.
 */
 
+constexpr size_t MapObstacle::maxPieceVertices;
+
 MapObstacle::MapObstacle() :
     pos(), localVertices(), decomposed(), damage(0) {}
 
@@ -58,11 +197,36 @@ void MapObstacle::decompose() {
   pp::Partition part;
   part.ConvexPartition_HM(&poly, &tmp);
 
-  for (auto p : tmp) {
-    decomposed.push_back(p.GetPoints());
+  for (auto &p : tmp) {
+    addPieces(p.GetPoints(), decomposed);
+  }
+}
+
+bool MapObstacle::adoptPieces(std::vector<std::vector<sf::Vector2f>> &&pieces) {
+  for (const auto &piece : pieces) {
+    if (!isFitPiece(piece)) return false;
   }
+  decomposed = std::move(pieces);
+  return true;
+}
+
+uint64_t MapObstacle::geometryHash() const {
+  uint64_t hash = hashBytes(hashBasis, &decompositionVersion,
+                            sizeof(decompositionVersion));
+  for (const auto &vertex : localVertices) {
+    hash = hashBytes(hash, &vertex.x, sizeof(vertex.x));
+    hash = hashBytes(hash, &vertex.y, sizeof(vertex.y));
+  }
+  return hash;
 }
 
+/**
+ * CachedDecomposition.
+ */
+
+CachedDecomposition::CachedDecomposition(const MapObstacle &obstacle) :
+    hash(obstacle.geometryHash()), pieces(obstacle.decomposed) {}
+
 /**
  * MapItem.
  */
@@ -71,23 +235,68 @@ void MapObstacle::decompose() {
  * Map.
  */
 
-Map::Map(std::istream &stream) :
+Map::Map(std::istream &stream, const ProgressMonitor &monitor) :
     dimensions(3200, 900),
     obstacles(),
     spawnPoints(),
     items(),
     loadSuccess(true) {
+  std::vector<CachedDecomposition> cache;
   try {
     cereal::JSONInputArchive ar(stream);
     serialize(ar);
+
+    try {
+      ar(cereal::make_nvp("decomposition", cache));
+    } catch (const cereal::Exception &e) {
+      cache.clear(); // it's optional
+    }
   } catch (const cereal::Exception &e) {
     appLog("Failed to parse map!", LogOrigin::Engine);
     loadSuccess = false;
     return;
   }
 
-  for (auto &o : obstacles) {
-    o.decompose();
+  if (!decomposeObstacles(std::move(cache), monitor)) loadSuccess = false;
+  indexSpawnPoints();
+}
+
+bool Map::decomposeObstacles(std::vector<CachedDecomposition> &&cache,
+                             const ProgressMonitor &monitor) {
+  size_t cached = 0;
+  for (size_t i = 0; i < obstacles.size(); i++) {
+    auto &obstacle = obstacles[i];
+    if (i < cache.size() and cache[i].hash == obstacle.geometryHash()
+        and obstacle.adoptPieces(std::move(cache[i].pieces))) {
+      ++cached;
+    } else obstacle.decompose();
+
+    if (monitor and !monitor(float(i + 1) / float(obstacles.size()))) {
+      appLog("Stopped loading map.", LogOrigin::Engine);
+      return false;
+    }
+  }
+
+  if (cached < obstacles.size() and !cache.empty()) {
+    appLog("Map's decomposition cache is stale or unfit for "
+               + std::to_string(obstacles.size() - cached)
+               + " obstacle(s); decomposing them.", LogOrigin::Engine);
+  }
+  return true;
+}
+
+void Map::indexSpawnPoints() {
+  for (size_t team = 0; team < teamSpawnPoints.size(); team++) {
+    auto &index = teamSpawnPoints[team];
+    index.clear();
+    for (size_t i = 0; i < spawnPoints.size(); i++) {
+      if (spawnPoints[i].team == Team(team)
+          or spawnPoints[i].team == Team::Spectator)
+        index.push_back(i);
+    }
+    if (index.empty()) {
+      for (size_t i = 0; i < spawnPoints.size(); i++) index.push_back(i);
+    }
   }
 }
 
@@ -111,24 +320,188 @@ const std::vector<SpawnPoint> &Map::getSpawnPoints() const {
   return spawnPoints;
 }
 
-const SpawnPoint Map::pickSpawnPoint(const Team team) const {
-  if (spawnPoints.size() > 0) {
-    return spawnPoints[0];
-  } else {
-    return SpawnPoint({200, 200}, 0, team); // default
+const SpawnPoint Map::pickSpawnPoint(const Team team,
+                                     const SpawnClearance &clearance) const {
+  const auto &candidates = teamSpawnPoints.at(size_t(team));
+  if (candidates.empty()) return SpawnPoint({200, 200}, 0, team); // default
+  if (!clearance) return spawnPoints[candidates[0]];
+
+  size_t best = candidates[0];
+  float bestClearance = -1;
+  for (const size_t i : candidates) {
+    const float candidateClearance = clearance(spawnPoints[i].pos);
+    if (candidateClearance > bestClearance) {
+      best = i;
+      bestClearance = candidateClearance;
+    }
   }
+  return spawnPoints[best];
 }
 
 void Map::save(std::ostream &s) {
+  std::vector<CachedDecomposition> cache;
+  for (const auto &obstacle : obstacles) cache.emplace_back(obstacle);
+
   cereal::JSONOutputArchive ar(s);
   serialize(ar);
+  ar(cereal::make_nvp("decomposition", cache));
 }
 
-optional<Map> Map::load(std::istream &stream) {
-  Map map{stream};
+optional<Map> Map::load(std::istream &stream,
+                        const ProgressMonitor &monitor) {
+  Map map{stream, monitor};
   if (map.loadSuccess) return map;
   else return {};
 }
 
+void Map::saveBinary(std::ostream &s) const {
+  std::vector<binary::Obstacle> obstacleRecords;
+  std::vector<binary::Piece> pieceRecords;
+  std::vector<binary::Spawn> spawnRecords;
+  std::vector<sf::Vector2f> vertices;
+
+  const auto addVertices = [&](const std::vector<sf::Vector2f> &added) {
+    vertices.insert(vertices.end(), added.begin(), added.end());
+  };
+
+  for (const auto &obstacle : obstacles) {
+    binary::Obstacle record{};
+    record.hash = obstacle.geometryHash();
+    record.x = obstacle.pos.x;
+    record.y = obstacle.pos.y;
+    record.damage = obstacle.damage;
+    record.firstVertex = uint32_t(vertices.size());
+    record.vertexCount = uint32_t(obstacle.localVertices.size());
+    addVertices(obstacle.localVertices);
+
+    record.firstPiece = uint32_t(pieceRecords.size());
+    record.pieceCount = uint32_t(obstacle.decomposed.size());
+    for (const auto &piece : obstacle.decomposed) {
+      pieceRecords.push_back({uint32_t(vertices.size()),
+                              uint32_t(piece.size())});
+      addVertices(piece);
+    }
+    obstacleRecords.push_back(record);
+  }
+
+  for (const auto &spawnPoint : spawnPoints) {
+    spawnRecords.push_back({spawnPoint.pos.x, spawnPoint.pos.y,
+                            float(spawnPoint.angle),
+                            uint32_t(spawnPoint.team)});
+  }
+
+  binary::Header header{};
+  std::memcpy(header.magic, binary::magic, sizeof(header.magic));
+  header.version = binary::version;
+  header.width = dimensions.x;
+  header.height = dimensions.y;
+  header.obstacles = uint32_t(obstacleRecords.size());
+  header.pieces = uint32_t(pieceRecords.size());
+  header.spawnPoints = uint32_t(spawnRecords.size());
+  header.vertices = uint32_t(vertices.size());
+
+  s.write((const char *) &header, sizeof(header));
+  binary::write(s, obstacleRecords);
+  binary::write(s, pieceRecords);
+  binary::write(s, spawnRecords);
+  binary::write(s, vertices);
+}
+
+optional<Map> Map::loadBinary(const unsigned char *data, const size_t size,
+                              const ProgressMonitor &monitor) {
+  const auto malformed = [](const std::string &problem) {
+    appLog("Failed to read binary map: " + problem, LogOrigin::Engine);
+    return optional<Map>();
+  };
+
+  binary::Header header;
+  if (size < sizeof(header)) return malformed("it's truncated.");
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, binary::magic, sizeof(header.magic)) != 0)
+    return malformed("it isn't a map.");
+  if (header.version != binary::version)
+    return malformed("its version is unsupported.");
+
+  // The counts are 32-bit, so none of this can overflow.
+  const size_t obstaclesAt = sizeof(header),
+      piecesAt = obstaclesAt + header.obstacles * sizeof(binary::Obstacle),
+      spawnsAt = piecesAt + header.pieces * sizeof(binary::Piece),
+      verticesAt = spawnsAt + header.spawnPoints * sizeof(binary::Spawn),
+      end = verticesAt + header.vertices * sizeof(sf::Vector2f);
+  if (end != size) return malformed("its size doesn't match its header.");
+
+  const auto readVertices = [&](const binary::Piece &range,
+                                std::vector<sf::Vector2f> &into) {
+    if (size_t(range.firstVertex) + range.vertexCount > header.vertices)
+      return false;
+    into.resize(range.vertexCount);
+    if (range.vertexCount)
+      std::memcpy(into.data(),
+                  data + verticesAt + range.firstVertex * sizeof(sf::Vector2f),
+                  range.vertexCount * sizeof(sf::Vector2f));
+    return true;
+  };
+
+  Map map;
+  map.dimensions = {header.width, header.height};
+
+  size_t stale = 0;
+  map.obstacles.resize(header.obstacles);
+  for (size_t i = 0; i < header.obstacles; i++) {
+    binary::Obstacle record;
+    std::memcpy(&record, data + obstaclesAt + i * sizeof(record),
+                sizeof(record));
+    auto &obstacle = map.obstacles[i];
+    obstacle.pos = {record.x, record.y};
+    obstacle.damage = record.damage;
+    if (!readVertices({record.firstVertex, record.vertexCount},
+                      obstacle.localVertices))
+      return malformed("an obstacle's vertices are out of range.");
+
+    bool cached = false;
+    if (record.hash == obstacle.geometryHash()) {
+      if (size_t(record.firstPiece) + record.pieceCount > header.pieces)
+        return malformed("an obstacle's pieces are out of range.");
+      std::vector<std::vector<sf::Vector2f>> pieces(record.pieceCount);
+      for (size_t j = 0; j < record.pieceCount; j++) {
+        binary::Piece piece;
+        std::memcpy(&piece, data + piecesAt
+            + (record.firstPiece + j) * sizeof(piece), sizeof(piece));
+        if (!readVertices(piece, pieces[j]))
+          return malformed("a piece's vertices are out of range.");
+      }
+      cached = obstacle.adoptPieces(std::move(pieces));
+    }
+    if (!cached) {
+      obstacle.decompose();
+      ++stale;
+    }
+
+    if (monitor and !monitor(float(i + 1) / float(header.obstacles))) {
+      appLog("Stopped loading map.", LogOrigin::Engine);
+      return {};
+    }
+  }
+
+  map.spawnPoints.reserve(header.spawnPoints);
+  for (size_t i = 0; i < header.spawnPoints; i++) {
+    binary::Spawn record;
+    std::memcpy(&record, data + spawnsAt + i * sizeof(record), sizeof(record));
+    if (record.team > uint32_t(Team::Blue))
+      return malformed("a spawn point has an unknown team.");
+    map.spawnPoints.emplace_back(sf::Vector2f(record.x, record.y),
+                                 record.angle, Team(record.team));
+  }
+
+  map.indexSpawnPoints();
+
+  if (stale) {
+    appLog("Binary map's decomposition is stale or unfit for "
+               + std::to_string(stale) + " obstacle(s); decomposing them.",
+           LogOrigin::Engine);
+  }
+  return map;
+}
+
 }
 
@@ -20,6 +20,8 @@
  */
 #pragma once
 #include <SFML/System.hpp>
+#include <array>
+#include <functional>
 #include <string>
 #include <ostream>
 #include <istream>
@@ -60,10 +62,19 @@ struct MapObstacle {
 
   sf::Vector2f pos;
   std::vector<sf::Vector2f> localVertices;
+  // Convex pieces, each fit to be a physics fixture as it is.
   std::vector<std::vector<sf::Vector2f>> decomposed;
   float damage;
 
+  // Box2D's limit on polygon vertices.
+  static constexpr size_t maxPieceVertices = 8;
+
   void decompose();
+  // Take pieces from a cache, if every one is fit to be a fixture.
+  bool adoptPieces(std::vector<std::vector<sf::Vector2f>> &&pieces);
+  // Identifies localVertices and the way we decompose them, so a cached
+  // decomposition can be checked against the obstacle.
+  uint64_t geometryHash() const;
 
   template<typename Archive>
   void serialize(Archive &ar) {
@@ -74,6 +85,25 @@ struct MapObstacle {
 
 };
 
+/**
+ * A MapObstacle's decomposition, cached in the map file so loading can skip
+ * the partitioning.
+ */
+struct CachedDecomposition {
+  CachedDecomposition() = default;
+  CachedDecomposition(const MapObstacle &obstacle);
+
+  uint64_t hash;
+  std::vector<std::vector<sf::Vector2f>> pieces;
+
+  template<typename Archive>
+  void serialize(Archive &ar) {
+    ar(cereal::make_nvp("hash", hash),
+       cereal::make_nvp("pieces", pieces));
+  }
+
+};
+
 /**
  * A map 'item' (currently unimplemented).
  */
@@ -104,7 +134,17 @@ struct Map {
   std::vector<MapItem> items;
   bool loadSuccess;
 
-  Map(std::istream &s);
+  // Indices of the spawn points each Team can use: its own and neutral
+  // (Spectator) ones, or all of them if there are none.
+  std::array<std::vector<size_t>, 3> teamSpawnPoints;
+  void indexSpawnPoints();
+
+  Map(std::istream &s, const ProgressMonitor &monitor);
+
+  // Decompose obstacles, except where the cache has them. False if the
+  // monitor stopped us.
+  bool decomposeObstacles(std::vector<CachedDecomposition> &&cache,
+                          const ProgressMonitor &monitor);
 
  public:
   Map(); // null map
@@ -123,11 +163,26 @@ struct Map {
   const std::vector<MapObstacle> &getObstacles() const;
   const std::vector<MapItem> &getItems() const;
   const std::vector<SpawnPoint> &getSpawnPoints() const;
-  const SpawnPoint pickSpawnPoint(const Team team) const;
-
-  // Safe reading / saving from / to streams.
+  // The team's spawn point with the most clearance, from a function that
+  // measures it (say, distance to the nearest enemy); the team's first spawn
+  // point without one.
+  using SpawnClearance = std::function<float(const sf::Vector2f &)>;
+  const SpawnPoint pickSpawnPoint(const Team team,
+                                  const SpawnClearance &clearance = {}) const;
+
+  // Safe reading / saving from / to streams. Saving writes the
+  // decomposition cache. The monitor follows obstacles being processed.
   void save(std::ostream &s);
-  static optional<Map> load(std::istream &s);
+  static optional<Map> load(std::istream &s,
+                            const ProgressMonitor &monitor = {});
+
+  // The binary format: flat arrays we copy out of the buffer (which can be
+  // a memory-mapped file) without parsing, decomposition included. The
+  // copy is one memcpy per vertex run, once per process (the Map is
+  // shared through the ComponentCache), so the buffer needn't outlive it.
+  void saveBinary(std::ostream &s) const;
+  static optional<Map> loadBinary(const unsigned char *data, const size_t size,
+                                  const ProgressMonitor &monitor = {});
 
 };
 
@@ -32,6 +32,16 @@ bool pullMessage(const FlowControlSettings &settings,
   return true;
 }
 
+TimeDiff updateJitter(const TimeDiff jitter, const TimeDiff transitChange) {
+  return jitter + (std::abs(transitChange) - jitter) / 16;
+}
+
+TimeDiff snapshotDelay(const SnapshotBufferSettings &settings,
+                       const TimeDiff interval, const TimeDiff jitter) {
+  return clamp(settings.minDelay, settings.maxDelay,
+               interval + settings.jitterDelay * jitter);
+}
+
 }
 
 /**
@@ -40,4 +50,14 @@ bool pullMessage(const FlowControlSettings &settings,
 FlowControlSettings::FlowControlSettings() :
     windowSize(0.1) { }
 
-}
\ No newline at end of file
+/**
+ * SnapshotBufferSettings.
+ */
+SnapshotBufferSettings::SnapshotBufferSettings() :
+    minDelay(0.05),
+    maxDelay(0.5),
+    jitterDelay(2),
+    maxExtrapolation(0.1),
+    maxSnapshots(32) { }
+
+}
@@ -20,6 +20,7 @@
  */
 #pragma once
 #include <queue>
+#include <deque>
 #include "util/types.hpp"
 
 namespace sky {
@@ -70,9 +71,9 @@ class FlowControl {
   optional<Message> pull(const Time localtime) {
     if (!messages.empty()) {
       if (detail::pullMessage(settings, localtime, messages.front().first)) {
-        const Message msg = messages.front().second;
+        optional<Message> msg{std::move(messages.front().second)};
         messages.pop();
-        return {msg};
+        return msg;
       }
     }
     return {};
@@ -80,4 +81,105 @@ class FlowControl {
 
 };
 
+/**
+ * State of a SnapshotBuffer, governing how far behind the sender we sample.
+ */
+struct SnapshotBufferSettings {
+  SnapshotBufferSettings(); // agnostic defaults
+
+  TimeDiff minDelay, maxDelay;
+  float jitterDelay; // delay per second of measured jitter
+  TimeDiff maxExtrapolation; // past the newest snapshot
+  size_t maxSnapshots;
+
+};
+
+namespace detail {
+
+// Running estimate of the jitter in transit time, given the change in
+// transit time between two consecutive snapshots.
+TimeDiff updateJitter(const TimeDiff jitter, const TimeDiff transitChange);
+
+// How far behind the sender's clock to sample.
+TimeDiff snapshotDelay(const SnapshotBufferSettings &settings,
+                       const TimeDiff interval, const TimeDiff jitter);
+
+}
+
+/**
+ * SnapshotBuffer class, templated on the Snapshot type. Push snapshots of
+ * some continuous state keyed by the sender's timestamps, and sample them at
+ * a delay, blending between the two snapshots around the sampled time.
+ *
+ * The delay is one snapshot interval plus a margin for the measured jitter,
+ * so there's usually a snapshot on either side of it. Snapshot provides
+ * `static Snapshot interpolate(from, to, t)` and
+ * `Snapshot extrapolate(TimeDiff) const`.
+ */
+template<typename Snapshot>
+class SnapshotBuffer {
+ private:
+  std::deque<std::pair<Time, Snapshot>> snapshots;
+  RollingSampler<TimeDiff> intervals;
+  optional<Time> lastTransit;
+  TimeDiff jitter;
+
+ public:
+  SnapshotBuffer(const SnapshotBufferSettings &settings) :
+      intervals(20), jitter(0), settings(settings) { }
+
+  SnapshotBufferSettings settings;
+
+  // A snapshot with a timestamp arrives; ones older than the newest are
+  // no use.
+  void push(const Time timestamp, const Snapshot &snapshot,
+            const Time localtime) {
+    if (!snapshots.empty()) {
+      if (timestamp <= snapshots.back().first) return;
+      intervals.push(TimeDiff(timestamp - snapshots.back().first));
+    }
+
+    const Time transit = localtime - timestamp;
+    if (lastTransit)
+      jitter = detail::updateJitter(jitter, TimeDiff(transit - *lastTransit));
+    lastTransit = transit;
+
+    snapshots.emplace_back(timestamp, snapshot);
+    if (snapshots.size() > settings.maxSnapshots) snapshots.pop_front();
+  }
+
+  TimeDiff getDelay() const {
+    return detail::snapshotDelay(
+        settings, intervals.mean<TimeDiff>(), jitter);
+  }
+
+  TimeDiff getJitter() const {
+    return jitter;
+  }
+
+  // Sample the state at a localtime, given how far our clock is ahead of
+  // the sender's. Snapshots before the sampled time are dropped, so
+  // localtime should not go backwards.
+  optional<Snapshot> sample(const Time localtime, const Time clockOffset) {
+    if (snapshots.empty()) return {};
+    const Time time = localtime - clockOffset - getDelay();
+
+    while (snapshots.size() > 1 and snapshots[1].first <= time)
+      snapshots.pop_front();
+
+    const auto &from = snapshots.front();
+    if (time <= from.first) return from.second;
+    if (snapshots.size() == 1) {
+      return from.second.extrapolate(TimeDiff(
+          std::min<Time>(time - from.first, settings.maxExtrapolation)));
+    }
+
+    const auto &to = snapshots[1];
+    return Snapshot::interpolate(
+        from.second, to.second,
+        float((time - from.first) / (to.first - from.first)));
+  }
+
+};
+
 }
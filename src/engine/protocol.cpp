@@ -59,9 +59,11 @@ ClientPacket ClientPacket::Pong(const Time pingTime,
   return packet;
 }
 
-ClientPacket ClientPacket::ReqJoin(const std::string &nickname) {
+ClientPacket ClientPacket::ReqJoin(const std::string &nickname,
+                                   const optional<std::string> &arenaName) {
   ClientPacket packet(Type::ReqJoin);
   packet.stringData = nickname;
+  packet.arenaName = arenaName;
   return packet;
 }
 
@@ -125,6 +127,10 @@ bool ServerPacket::verifyStructure() const {
       return verifyRequiredOptionals(skyHandleDelta);
     case Type::DeltaSky:
       return verifyRequiredOptionals(timestamp, skyDelta);
+    case Type::SkyInterest:
+      return verifyRequiredOptionals(entered, left);
+    case Type::SpawnProps:
+      return verifyRequiredOptionals(timestamp, propSpawns);
     case Type::DeltaScore:
       return verifyRequiredOptionals(scoreDelta);
     case Type::Chat:
@@ -133,6 +139,8 @@ bool ServerPacket::verifyStructure() const {
       return verifyRequiredOptionals(stringData);
     case Type::RCon:
       return verifyRequiredOptionals(stringData);
+    case Type::Redirect:
+      return verifyRequiredOptionals(stringData, port);
   }
   return false;
 }
@@ -182,6 +190,22 @@ ServerPacket ServerPacket::DeltaSky(const SkyDelta &skyDelta,
   return packet;
 }
 
+ServerPacket ServerPacket::SkyInterest(const std::vector<PID> &entered,
+                                       const std::vector<PID> &left) {
+  ServerPacket packet(Type::SkyInterest);
+  packet.entered = entered;
+  packet.left = left;
+  return packet;
+}
+
+ServerPacket ServerPacket::SpawnProps(const SkyPropSpawns &propSpawns,
+                                      const Time spawnTime) {
+  ServerPacket packet(Type::SpawnProps);
+  packet.propSpawns = propSpawns;
+  packet.timestamp = spawnTime;
+  return packet;
+}
+
 ServerPacket ServerPacket::DeltaScore(const ScoreboardDelta &scoreDelta) {
   ServerPacket packet(Type::DeltaScore);
   packet.scoreDelta = scoreDelta;
@@ -207,4 +231,12 @@ ServerPacket ServerPacket::RCon(const std::string &message) {
   return packet;
 }
 
+ServerPacket ServerPacket::Redirect(const std::string &arenaName,
+                                    const Port port) {
+  ServerPacket packet(Type::Redirect);
+  packet.stringData = arenaName;
+  packet.port = port;
+  return packet;
+}
+
 }
@@ -55,7 +55,7 @@ struct ClientPacket : public VerifyStructure {
         break;
       }
       case Type::ReqJoin: {
-        ar(stringData);
+        ar(stringData, arenaName);
         break;
       }
       case Type::ReqSky: {
@@ -93,6 +93,7 @@ struct ClientPacket : public VerifyStructure {
   Type type;
   optional<Time> pingTime, pongTime;
   optional<std::string> stringData;
+  optional<std::string> arenaName;
   optional<PlayerDelta> playerDelta;
   optional<Team> team;
   optional<ParticipationInput> participationInput;
@@ -101,7 +102,8 @@ struct ClientPacket : public VerifyStructure {
   bool verifyStructure() const override;
 
   static ClientPacket Pong(const Time pingTime, const Time pongTime);
-  static ClientPacket ReqJoin(const std::string &nickname);
+  static ClientPacket ReqJoin(const std::string &nickname,
+                              const optional<std::string> &arenaName = {});
   static ClientPacket ReqSky();
   static ClientPacket ReqPlayerDelta(const PlayerDelta &playerDelta);
   static ClientPacket ReqInput(const ParticipationInput &input);
@@ -124,11 +126,15 @@ struct ServerPacket : public VerifyStructure {
     DeltaArena, // broadcast a change in the Arena
     DeltaSkyHandle, // broadcast a change in the SkyHandle
     DeltaSky, // broadcast a change in the Sky
+    SkyInterest, // participations entering / leaving a client's vicinity
+    SpawnProps, // props spawned in the Sky, sent reliably
     DeltaScore, // broadcast a change in the Scoreboard
 
     Chat, // chat relay to all clients
     Broadcast, // broadcast message, to any subset of clients
-    RCon // rcon message, to one client
+    RCon, // rcon message, to one client
+
+    Redirect // answer a ReqJoin for an arena hosted on another port
   };
 
   ServerPacket();
@@ -162,6 +168,14 @@ struct ServerPacket : public VerifyStructure {
         ar(timestamp, skyDelta);
         break;
       }
+      case Type::SkyInterest: {
+        ar(entered, left);
+        break;
+      }
+      case Type::SpawnProps: {
+        ar(timestamp, propSpawns);
+        break;
+      }
       case Type::DeltaScore: {
         ar(scoreDelta);
         break;
@@ -178,6 +192,10 @@ struct ServerPacket : public VerifyStructure {
         ar(stringData);
         break;
       }
+      case Type::Redirect: {
+        ar(stringData, port);
+        break;
+      }
     }
   }
 
@@ -191,9 +209,12 @@ struct ServerPacket : public VerifyStructure {
   optional<ArenaDelta> arenaDelta;         // DeltaArena
   optional<SkyHandleDelta> skyHandleDelta; // DeltaSkyHandle
   optional<SkyDelta> skyDelta;             // DeltaSky
-  optional<Time> timestamp;
+  optional<Time> timestamp;                // Ping, DeltaSky, SpawnProps
+  optional<std::vector<PID>> entered, left; // SkyInterest
+  optional<SkyPropSpawns> propSpawns;      // SpawnProps
   optional<ScoreboardDelta> scoreDelta;    // DeltaScore
-  optional<std::string> stringData; // Chat, Broadcast, RCon
+  optional<std::string> stringData; // Chat, Broadcast, RCon, Redirect
+  optional<Port> port;                     // Redirect
 
   bool verifyStructure() const override;
 
@@ -207,10 +228,15 @@ struct ServerPacket : public VerifyStructure {
   static ServerPacket DeltaSkyHandle(const SkyHandleDelta &skyhandleDelta);
   static ServerPacket DeltaSky(const SkyDelta &skyDelta,
                                const Time pingTime);
+  static ServerPacket SkyInterest(const std::vector<PID> &entered,
+                                 const std::vector<PID> &left);
+  static ServerPacket SpawnProps(const SkyPropSpawns &propSpawns,
+                                 const Time spawnTime);
   static ServerPacket DeltaScore(const ScoreboardDelta &scoreDelta);
   static ServerPacket Chat(const PID pid, const std::string &chat);
   static ServerPacket Broadcast(const std::string &broadcast);
   static ServerPacket RCon(const std::string &message);
+  static ServerPacket Redirect(const std::string &arenaName, const Port port);
 
 };
 
@@ -15,15 +15,90 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <SFML/Graphics/Rect.hpp>
 #include "sky.hpp"
 #include "engine/arena.hpp"
+#include "engine/flowcontrol.hpp"
 #include "participation.hpp"
 #include "util/printer.hpp"
 
 namespace sky {
 
+namespace {
+
+// Whether input sequence a comes after b, allowing for wrap-around.
+bool sequenceAfter(const uint32_t a, const uint32_t b) {
+  return int32_t(a - b) > 0;
+}
+
+}
+
+/**
+ * PlaneHistory.
+ */
+
+constexpr size_t PlaneHistory::capacity;
+
+const std::pair<Time, PhysicalState> &PlaneHistory::nth(const size_t n) const {
+  return records[(oldest + n) % capacity];
+}
+
+PlaneHistory::PlaneHistory() :
+    oldest(0), count(0) { }
+
+void PlaneHistory::record(const Time time, const PhysicalState &physical) {
+  if (count < capacity) {
+    records[(oldest + count) % capacity] = {time, physical};
+    ++count;
+  } else {
+    records[oldest] = {time, physical};
+    oldest = (oldest + 1) % capacity;
+  }
+}
+
+void PlaneHistory::clear() {
+  oldest = 0;
+  count = 0;
+}
+
+bool PlaneHistory::isEmpty() const {
+  return count == 0;
+}
+
+optional<PhysicalState> PlaneHistory::rewind(const Time time) const {
+  if (count == 0) return {};
+  if (time <= nth(0).first) return nth(0).second;
+  if (time >= nth(count - 1).first) return nth(count - 1).second;
+
+  // first record after the time
+  size_t low = 1, high = count - 1;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (nth(mid).first > time) high = mid;
+    else low = mid + 1;
+  }
+
+  const auto &from = nth(low - 1), &to = nth(low);
+  return PhysicalState::interpolate(
+      from.second, to.second,
+      float((time - from.first) / (to.first - from.first)));
+}
+
+bool PlaneHistory::contains(const Time time, const sf::Vector2f &hitbox,
+                            const sf::Vector2f &point) const {
+  const auto physical = rewind(time);
+  if (!physical) return false;
+
+  const sf::Vector2f forward = VecMath::fromAngle(physical->rot),
+      offset = point - physical->pos;
+  const float along = offset.x * forward.x + offset.y * forward.y,
+      across = offset.y * forward.x - offset.x * forward.y;
+  return std::abs(along) <= hitbox.x / 2 and std::abs(across) <= hitbox.y / 2;
+}
+
 /**
  * Plane.
  */
@@ -50,7 +125,8 @@ void Plane::switchStall() {
   }
 }
 
-void Plane::tickFlight(const TimeDiff delta) {
+void Plane::tickFlight(const PlaneControls &controls,
+                       const TimeDiff delta) {
   switchStall();
   const float velocity = state.velocity();
 
@@ -148,10 +224,33 @@ void Plane::prePhysics() {
 
 void Plane::postPhysics(const TimeDiff delta) {
   readFromBody();
-  tickFlight(delta);
+  tickFlight(controls, delta);
   tickWeapons(delta);
 }
 
+void Plane::reconcile(const PlaneStateServer &acked,
+                      const std::deque<InputRecord> &unacked,
+                      const TimeDiff serverAhead) {
+  // Replay on our state, then keep only what the replay was for.
+  const PlaneState predicted = state;
+  state.applyServer(acked);
+  TimeDiff covered = serverAhead;
+  for (const auto &input : unacked) {
+    // The server's own ticks since the ack stand in for ours, to the
+    // nearest tick.
+    if (covered >= input.delta / 2) {
+      covered -= input.delta;
+      continue;
+    }
+    state.applyClient(input.state);
+    tickFlight(input.controls, input.delta);
+    tickWeapons(input.delta);
+  }
+  const PlaneStateServer replayed(state);
+  state = predicted;
+  state.applyServer(replayed);
+}
+
 void Plane::onBeginContact(const BodyTag &body) {
   if (body.type == BodyTag::Type::PropTag) {
     if (body.prop->associatedPlayer != associatedPlayer) {
@@ -241,7 +340,12 @@ ParticipationInit::ParticipationInit(
  */
 
 bool ParticipationDelta::verifyStructure() const {
-  return imply(bool(spawn), !bool(state));
+  return imply(bool(spawn), !bool(state) and !bool(stateDelta))
+      and !(state and stateDelta);
+}
+
+bool ParticipationDelta::needsReliable() const {
+  return spawn or state;
 }
 
 ParticipationDelta ParticipationDelta::respectClientAuthority() const {
@@ -250,6 +354,10 @@ ParticipationDelta ParticipationDelta::respectClientAuthority() const {
     delta.serverState.emplace(state.get());
     delta.state.reset();
   }
+  if (stateDelta) {
+    delta.stateDelta = stateDelta->respectClientAuthority();
+    if (delta.stateDelta->isEmpty()) delta.stateDelta.reset();
+  }
   delta.controls.reset();
   return delta;
 }
@@ -261,6 +369,30 @@ ParticipationDelta ParticipationDelta::respectClientAuthority() const {
 void Participation::spawnWithState(const PlaneTuning &tuning,
                                    const PlaneState &state) {
   plane.emplace(associatedPlayer, physics, controls, tuning, state);
+  unackedInputs.clear();
+  history.clear();
+  serverKeyframe.emplace(state);
+}
+
+bool Participation::hasKeyframe(const ParticipationDelta &delta) const {
+  return delta.keyframe == keyframeSequence
+      and (predicting ? bool(serverKeyframe) : bool(lastKeyframe));
+}
+
+void Participation::reconcile(const ParticipationDelta &delta) {
+  if (delta.serverState) serverKeyframe = delta.serverState;
+  if (!delta.inputAck or !serverKeyframe) return;
+
+  while (!unackedInputs.empty()
+      and !sequenceAfter(unackedInputs.front().sequence, *delta.inputAck))
+    unackedInputs.pop_front();
+
+  // The server's state as of the acked input: its keyframe with this delta.
+  PlaneState acked = plane->state;
+  acked.applyServer(*serverKeyframe);
+  if (delta.stateDelta) delta.stateDelta->apply(acked);
+  plane->reconcile(PlaneStateServer(acked), unackedInputs,
+                   delta.inputAckAge.get_value_or(0));
 }
 
 void Participation::doAction(const Action action, bool actionState) {
@@ -285,7 +417,17 @@ void Participation::prePhysics() {
 }
 
 void Participation::postPhysics(const float delta) {
-  if (plane) plane->postPhysics(delta);
+  if (plane) {
+    if (predicting) {
+      plane->readFromBody(); // the state flight is about to tick from
+      unackedInputs.push_back(InputRecord{++inputSequence, controls,
+                                          PlaneStateClient(plane->state),
+                                          delta});
+      if (unackedInputs.size() > maxUnackedInputs) unackedInputs.pop_front();
+    }
+    plane->postPhysics(delta);
+  }
+  if (inputAck) inputAge += delta;
 
   for (auto &prop : props) {
     prop.second.readFromBody();
@@ -293,6 +435,11 @@ void Participation::postPhysics(const float delta) {
   }
 }
 
+void Participation::recordHistory(const Time time) {
+  if (plane) history.record(time, plane->state.physical);
+  else history.clear();
+}
+
 void Participation::spawn(const PlaneTuning &tuning,
                           const sf::Vector2f &pos,
                           const float rot) {
@@ -308,6 +455,11 @@ Participation::Participation(const PID associatedPlayer,
     controls(),
     newlyAlive(false),
     lastControls(),
+    keyframeSequence(initializer.keyframeSequence),
+    predicting(false),
+    inputSequence(0),
+    inputAge(0),
+    viewDelay(0),
 
     associatedPlayer(associatedPlayer),
     plane(),
@@ -316,6 +468,8 @@ Participation::Participation(const PID associatedPlayer,
     spawnWithState(initializer.spawn->first, initializer.spawn->second);
   controls = initializer.controls;
   lastControls = initializer.controls;
+  lastKeyframe = initializer.keyframe;
+  if (lastKeyframe) serverKeyframe.emplace(*lastKeyframe);
   for (const auto &prop : initializer.props) {
     props.emplace(std::piecewise_construct,
                   std::forward_as_tuple(prop.first),
@@ -325,47 +479,84 @@ Participation::Participation(const PID associatedPlayer,
 }
 
 void Participation::applyDelta(const ParticipationDelta &delta) {
+  applyDelta(delta, std::numeric_limits<Time>::infinity());
+}
+
+void Participation::applyDelta(const ParticipationDelta &delta,
+                               const Time timestamp) {
   // Apply plane spawn / state.
   if (delta.spawn) {
     spawnWithState(delta.spawn->first, delta.spawn->second);
+    lastKeyframe = delta.spawn->second;
+    keyframeSequence = delta.keyframe;
   } else {
     if (delta.planeAlive) {
       if (plane) {
-        if (delta.state) plane->state = delta.state.get();
-        else if (delta.serverState)
+        if (delta.state) {
+          plane->state = delta.state.get();
+          lastKeyframe = delta.state;
+          keyframeSequence = delta.keyframe;
+        } else if (delta.serverState) {
           plane->state.applyServer(delta.serverState.get());
+          keyframeSequence = delta.keyframe;
+        }
+
+        // A snapshot can overtake the keyframe it's relative to, or trail a
+        // newer one; then its state is no use, and we wait for the next.
+        if (hasKeyframe(delta)) {
+          if (!delta.state and !delta.serverState and !predicting) {
+            // the delta is relative to it, not to what we're displaying
+            plane->state = *lastKeyframe;
+          }
+          if (delta.stateDelta) delta.stateDelta->apply(plane->state);
+          if (predicting) reconcile(delta);
+        }
       }
-    } else plane.reset();
+    } else {
+      plane.reset();
+      lastKeyframe.reset();
+    }
   }
 
-  // Apply prop deltas / erasure.
+  // Apply prop erasure; new props come from applyPropSpawns, and those
+  // spawned after the delta was collected aren't in it yet.
   auto iter = props.begin();
   while (iter != props.end()) {
-    if (delta.propDeltas.find(iter->first) == delta.propDeltas.end()) {
+    if (delta.propDeltas.find(iter->first) == delta.propDeltas.end()
+        and iter->second.spawnTime <= timestamp) {
       const auto toErase = iter;
       ++iter;
       props.erase(toErase);
     } else ++iter;
   }
 
-  // Create new props.
-  for (const auto &init : delta.propInits) {
-    props.emplace(std::piecewise_construct,
-                  std::forward_as_tuple(init.first),
-                  std::forward_as_tuple(associatedPlayer, physics,
-                                        init.second));
-  }
-
   // Modify controls.
   if (delta.controls) {
     controls = *delta.controls;
   }
 }
 
+void Participation::applyLateDelta(const ParticipationDelta &delta) {
+  if (delta.spawn) {
+    // the newer deltas couldn't apply to a plane from before it
+    spawnWithState(delta.spawn->first, delta.spawn->second);
+    lastKeyframe = delta.spawn->second;
+    keyframeSequence = delta.keyframe;
+  } else if (delta.state) {
+    lastKeyframe = delta.state;
+    keyframeSequence = delta.keyframe;
+  } else if (delta.serverState) {
+    serverKeyframe = delta.serverState;
+    keyframeSequence = delta.keyframe;
+  }
+}
+
 ParticipationInit Participation::captureInitializer() const {
   ParticipationInit init{controls};
   if (plane) {
     init.spawn.emplace(plane->tuning, plane->state);
+    init.keyframe = lastKeyframe;
+    init.keyframeSequence = keyframeSequence;
   }
   for (const auto &prop : props) {
     init.props.emplace(prop.first, prop.second.captureInitializer());
@@ -373,7 +564,7 @@ ParticipationInit Participation::captureInitializer() const {
   return init;
 }
 
-ParticipationDelta Participation::collectDelta() {
+ParticipationDelta Participation::collectDelta(const bool keyframe) {
   ParticipationDelta delta;
 
   delta.planeAlive = bool(plane);
@@ -381,23 +572,67 @@ ParticipationDelta Participation::collectDelta() {
     if (newlyAlive) {
       delta.spawn.emplace(plane->tuning, plane->state);
       newlyAlive = false;
-    } else {
+      lastKeyframe = plane->state;
+      ++keyframeSequence;
+    } else if (keyframe or !lastKeyframe) {
       delta.state.emplace(plane->state);
+      lastKeyframe = plane->state;
+      ++keyframeSequence;
+    } else {
+      // Relative to the last keyframe rather than the last delta, so any
+      // snapshot can be lost without the next one depending on it.
+      PlaneStateDelta stateDelta(*lastKeyframe, plane->state);
+      if (!stateDelta.isEmpty()) delta.stateDelta = std::move(stateDelta);
     }
-  }
+  } else lastKeyframe.reset();
+  delta.keyframe = keyframeSequence;
+
+  // new props too, so a snapshot overtaking their spawn doesn't erase them
+  for (auto &prop : props)
+    delta.propDeltas.emplace(prop.first, prop.second.collectDelta());
+
+  delta.controls = controls;
+  delta.inputAck = inputAck;
+  if (inputAck) delta.inputAckAge = inputAge;
+
+  return delta;
+}
 
+std::map<PID, PropInit> Participation::collectPropSpawns() {
+  std::map<PID, PropInit> spawns;
   for (auto &prop : props) {
     if (prop.second.newlyAlive) {
-      delta.propInits.emplace(prop.first, prop.second.captureInitializer());
+      spawns.emplace(prop.first, prop.second.captureInitializer());
       prop.second.newlyAlive = false;
-    } else {
-      delta.propDeltas.emplace(prop.first, prop.second.collectDelta());
     }
   }
+  return spawns;
+}
 
-  delta.controls = controls;
+void Participation::applyPropSpawns(const std::map<PID, PropInit> &spawns,
+                                    const Time timestamp) {
+  for (const auto &init : spawns) {
+    props.erase(init.first); // the PID of a prop that died since
+    props.emplace(std::piecewise_construct,
+                  std::forward_as_tuple(init.first),
+                  std::forward_as_tuple(associatedPlayer, physics,
+                                        init.second))
+        .first->second.spawnTime = timestamp;
+  }
+}
 
-  return delta;
+ParticipationDelta Participation::resyncDelta(
+    const ParticipationDelta &delta, const bool spawn) const {
+  ParticipationDelta resynced{delta};
+  resynced.spawn.reset();
+  resynced.state.reset();
+  resynced.stateDelta.reset();
+  if (plane and lastKeyframe) {
+    if (spawn) resynced.spawn.emplace(plane->tuning, *lastKeyframe);
+    else resynced.state = lastKeyframe;
+  }
+  resynced.keyframe = keyframeSequence;
+  return resynced;
 }
 
 const PlaneControls &Participation::getControls() const {
@@ -408,6 +643,18 @@ bool Participation::isSpawned() const {
   return bool(plane);
 }
 
+const PlaneHistory &Participation::getHistory() const {
+  return history;
+}
+
+TimeDiff Participation::getViewDelay() const {
+  return viewDelay;
+}
+
+void Participation::displayPhysical(const PhysicalState &physical) {
+  if (plane) plane->state.physical = physical;
+}
+
 void Participation::spawnProp(const PropInit &init) {
   props.emplace(std::piecewise_construct,
                 std::forward_as_tuple(smallestUnused(props)),
@@ -419,9 +666,20 @@ void Participation::suicide() {
 }
 
 void Participation::applyInput(const ParticipationInput &input) {
+  // Inputs are snapshots; one older than what we have is no use.
+  if (inputAck and sequenceAfter(*inputAck, input.sequence)) return;
+  inputAck = input.sequence;
+  inputAge = 0;
+
   if (input.controls) {
     controls = input.controls.get();
   }
+  // Clients show others no further behind than a SnapshotBuffer's maxDelay;
+  // claiming more would only buy a shooter more rewind.
+  if (input.viewDelay) {
+    viewDelay = clamp(0.0f, SnapshotBufferSettings().maxDelay,
+                      *input.viewDelay);
+  }
 
   if (plane) {
     if (input.planeState)
@@ -432,17 +690,22 @@ void Participation::applyInput(const ParticipationInput &input) {
 optional<ParticipationInput> Participation::collectInput() {
   bool useful{false};
   ParticipationInput input;
+  input.sequence = inputSequence;
+  predicting = true;
   if (lastControls != controls) {
     useful = true;
-    input.controls = controls;
     lastControls = controls;
   }
   if (plane) {
     useful = true;
     input.planeState.emplace(plane->getState());
   }
-  if (useful) return input;
-  else return {};
+  if (useful) {
+    // inputs are sent as snapshots and can be lost, so they always carry
+    // the controls
+    input.controls = controls;
+    return input;
+  } else return {};
 }
 
 }
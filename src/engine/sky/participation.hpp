@@ -20,14 +20,58 @@
  */
 #pragma once
 #include <Box2D/Box2D.h>
+#include <array>
+#include <deque>
 #include <forward_list>
 #include "util/types.hpp"
+#include "util/slotmap.hpp"
 #include "prop.hpp"
 #include "physics.hpp"
 #include "planestate.hpp"
 
 namespace sky {
 
+/**
+ * A tick of the local plane's flight, kept by the client until the server
+ * acks an input covering it, so it can be replayed over the server's state.
+ */
+struct InputRecord {
+  uint32_t sequence;
+  PlaneControls controls;
+  PlaneStateClient state; // as flight was ticked from
+  TimeDiff delta;
+};
+
+/**
+ * Where a plane was over its last ticks, so the server can rewind it to what
+ * a lagging client saw. Fixed capacity, overwriting the oldest records.
+ */
+class PlaneHistory {
+ public:
+  static constexpr size_t capacity = 64; // about a second of server ticks
+
+ private:
+  std::array<std::pair<Time, PhysicalState>, capacity> records;
+  size_t oldest, count;
+
+  const std::pair<Time, PhysicalState> &nth(const size_t n) const;
+
+ public:
+  PlaneHistory();
+
+  void record(const Time time, const PhysicalState &physical);
+  void clear();
+  bool isEmpty() const;
+
+  // Between the records around a time, or the oldest / newest if the time
+  // is out of range.
+  optional<PhysicalState> rewind(const Time time) const;
+  // Whether a point was inside the plane's hitbox at a time.
+  bool contains(const Time time, const sf::Vector2f &hitbox,
+                const sf::Vector2f &point) const;
+
+};
+
 /**
  * The plane element that can be associated with a Participation.
  * This is essentially a piece of Participations's implementation.
@@ -47,10 +91,16 @@ class Plane {
 
   // Subroutines.
   void switchStall();
-  void tickFlight(const TimeDiff delta);
+  void tickFlight(const PlaneControls &controls, const TimeDiff delta);
   void tickWeapons(const TimeDiff delta);
   void writeToBody();
   void readFromBody();
+  // Take the server's state for the fields it has authority over, with the
+  // effect of the inputs it hasn't seen yet replayed on top; the first
+  // serverAhead seconds of them the server has ticked through already.
+  void reconcile(const PlaneStateServer &acked,
+                 const std::deque<InputRecord> &unacked,
+                 const TimeDiff serverAhead);
 
   // Sky API.
   void prePhysics();
@@ -94,12 +144,15 @@ struct ParticipationInit {
 
   template<typename Archive>
   void serialize(Archive &ar) {
-    ar(spawn, controls, props);
+    ar(spawn, controls, props, keyframe, keyframeSequence);
   }
 
   optional<std::pair<PlaneTuning, PlaneState>> spawn;
   PlaneControls controls;
   std::map<PID, PropInit> props;
+  // What the next deltas' plane state is relative to.
+  optional<PlaneState> keyframe;
+  uint8_t keyframeSequence = 0;
 
 };
 
@@ -111,19 +164,31 @@ struct ParticipationDelta: public VerifyStructure {
 
   template<typename Archive>
   void serialize(Archive &ar) {
-    ar(spawn, planeAlive, state, serverState, controls);
-    ar(propInits, propDeltas);
+    ar(spawn, planeAlive, keyframe, state, stateDelta, serverState, controls);
+    ar(inputAck, inputAckAge, propDeltas);
   }
 
   bool verifyStructure() const;
+  // Whether it has to be sent reliably, rather than as a loss-tolerant
+  // snapshot.
+  bool needsReliable() const;
 
   optional<std::pair<PlaneTuning, PlaneState>> spawn;
   bool planeAlive;
-  optional<PlaneState> state; // if client doesn't have authority
-  optional<PlaneStateServer> serverState; // if client has authority
+  // Sequence of the keyframe this delta carries (spawn or state), or that
+  // its stateDelta is relative to; it wraps, and is only compared for
+  // equality.
+  uint8_t keyframe = 0;
+  optional<PlaneState> state; // keyframe, if client doesn't have authority
+  optional<PlaneStateDelta> stateDelta; // changes since the last keyframe
+  optional<PlaneStateServer> serverState; // keyframe, if client has authority
   optional<PlaneControls> controls; // client authority
+  optional<uint32_t> inputAck; // latest ParticipationInput sequence applied
+  // How long the server has ticked since it applied that input, which the
+  // state here already includes.
+  optional<TimeDiff> inputAckAge;
 
-  std::map<PID, PropInit> propInits;
+  // Every live prop; new ones are created from Sky::collectPropSpawns.
   std::map<PID, PropDelta> propDeltas;
 
   ParticipationDelta respectClientAuthority() const;
@@ -139,11 +204,14 @@ struct ParticipationInput {
 
   template<typename Archive>
   void serialize(Archive &ar) {
-    ar(planeState, controls);
+    ar(sequence, planeState, controls, viewDelay);
   }
 
+  uint32_t sequence = 0; // of the client's latest tick, acked in deltas
   optional<PlaneStateClient> planeState;
   optional<PlaneControls> controls;
+  // How far behind the server's clock the client shows other planes.
+  optional<TimeDiff> viewDelay;
 
 };
 
@@ -163,15 +231,39 @@ class Participation: public Networked<ParticipationInit, ParticipationDelta> {
   // Delta collection state.
   bool newlyAlive;
   PlaneControls lastControls;
+  // Plane state as last sent reliably (or received, on the client), and
+  // the sequence of that keyframe (or of serverKeyframe, when predicting).
+  optional<PlaneState> lastKeyframe;
+  uint8_t keyframeSequence;
+
+  // Client-side prediction, for the participation we collect input from:
+  // every tick since the last one the server acked, and the server state
+  // its deltas are relative to.
+  bool predicting;
+  uint32_t inputSequence;
+  std::deque<InputRecord> unackedInputs;
+  optional<PlaneStateServer> serverKeyframe;
+  // Server side: the sequence of the latest input applied, and how long
+  // we've ticked since.
+  optional<uint32_t> inputAck;
+  TimeDiff inputAge;
+  // Server side: recent plane positions, for lag compensation, and how far
+  // behind them the client's view of other planes is.
+  PlaneHistory history;
+  TimeDiff viewDelay;
 
   // Helpers.
   void spawnWithState(const PlaneTuning &tuning,
                       const PlaneState &state);
+  void reconcile(const ParticipationDelta &delta);
+  // Whether we hold the keyframe a delta's state is relative to.
+  bool hasKeyframe(const ParticipationDelta &delta) const;
 
   // Sky API.
   void doAction(const Action action, bool actionState);
   void prePhysics();
   void postPhysics(const float delta);
+  void recordHistory(const Time time);
 
   void spawn(const PlaneTuning &tuning,
              const sf::Vector2f &pos,
@@ -186,16 +278,41 @@ class Participation: public Networked<ParticipationInit, ParticipationDelta> {
   // State.
   const PID associatedPlayer;
   optional<Plane> plane;
-  std::map<PID, Prop> props;
+  SlotMap<Prop> props;
+
+  // Ticks we keep for replay; older ones are dropped, unacked or not.
+  static constexpr size_t maxUnackedInputs = 240;
 
   // Networked impl (for Sky).
   void applyDelta(const ParticipationDelta &delta) override;
+  // A delta the server collected at a time: props spawned after it are
+  // missing from it, but not dead.
+  void applyDelta(const ParticipationDelta &delta, const Time timestamp);
+  // A reliable delta older than one already applied: keep the keyframe
+  // later deltas build on, without moving the plane back in time.
+  void applyLateDelta(const ParticipationDelta &delta);
   ParticipationInit captureInitializer() const override;
-  ParticipationDelta collectDelta();
+  ParticipationDelta collectDelta(const bool keyframe = false);
+  // Props spawned since the last call, and creating them from that.
+  std::map<PID, PropInit> collectPropSpawns();
+  void applyPropSpawns(const std::map<PID, PropInit> &spawns,
+                       const Time timestamp);
+  // This tick's delta, for a client that missed our reliable ones: our last
+  // keyframe in full instead of relative to it, as a spawn if the plane may
+  // be new to them.
+  ParticipationDelta resyncDelta(const ParticipationDelta &delta,
+                                 const bool spawn) const;
 
   // User API.
   const PlaneControls &getControls() const;
   bool isSpawned() const;
+  const PlaneHistory &getHistory() const;
+  TimeDiff getViewDelay() const;
+
+  // User API, clientside.
+  // Show the plane somewhere between the server's snapshots; the next delta
+  // puts it back where the server has it.
+  void displayPhysical(const PhysicalState &physical);
 
   // User API, serverside.
   void spawnProp(const PropInit &init);
@@ -77,10 +77,51 @@ void PhysicsDispatcher::PreSolve(b2Contact *contact, const b2Manifold *oldManifo
   }
 }
 
+/**
+ * NearestBodyQuery.
+ */
+
+namespace {
+
+/**
+ * Finds the nearest weighed body amongst those a b2World query reports.
+ */
+class NearestBodyQuery: public b2QueryCallback {
+ private:
+  const Physics &physics;
+  const sf::Vector2f pos;
+  const std::function<float(const BodyTag &)> &weigh;
+
+ public:
+  NearestBodyQuery(const Physics &physics, const sf::Vector2f &pos,
+                   const std::function<float(const BodyTag &)> &weigh,
+                   const float maxDistance) :
+      physics(physics), pos(pos), weigh(weigh), nearest(maxDistance) {}
+
+  float nearest;
+
+  bool ReportFixture(b2Fixture *fixture) override {
+    const b2Body *body = fixture->GetBody();
+    if (const auto tag = (const BodyTag *) body->GetUserData()) {
+      if (const float weight = weigh(*tag)) {
+        const sf::Vector2f bodyPos = physics.toGameVec(body->GetPosition());
+        nearest = std::min(nearest, weight * VecMath::length(bodyPos - pos));
+      }
+    }
+    return true;
+  }
+
+};
+
+}
+
 /**
  * Physics.
  */
 
+static_assert(MapObstacle::maxPieceVertices <= b2_maxPolygonVertices,
+              "Map obstacle pieces must fit in a b2PolygonShape.");
+
 Physics::Physics(const Map &map, PhysicsListener &listener) :
     world({0, Settings().gravity / Settings().distanceScale}),
     converter(listener),
@@ -96,13 +137,37 @@ Physics::Physics(const Map &map, PhysicsListener &listener) :
   body = createBody(rectShape({1, dims.y}), BodyTag::BoundaryTag(), true);
   body->SetTransform(toPhysVec({0, dims.y / 2}), 0);
 
-  // obstacles
-  for (const auto &obstacle : map.getObstacles()) {
-    body = createBody(chainLoopShape(obstacle.localVertices),
-                      BodyTag::ObstacleTag(obstacle), true);
+  // obstacles, from the convex pieces the map decomposed them into on load
+  const auto &obstacles = map.getObstacles();
+  for (size_t n = 0; n < obstacles.size(); n++) {
+    const auto &obstacle = obstacles[n];
+    if (obstacle.decomposed.empty()) {
+      if (obstacle.localVertices.size() < 2) {
+        appLog("Skipping obstacle " + std::to_string(n)
+                   + ", it has no shape.", LogOrigin::Engine);
+        continue;
+      }
+      // its outline still keeps planes out, if less robustly
+      appLog("Obstacle " + std::to_string(n) + " has no convex pieces; "
+          "using its outline.", LogOrigin::Engine);
+      body = createBody(chainLoopShape(obstacle.localVertices),
+                        BodyTag::ObstacleTag(obstacle), true);
+    } else {
+      body = createBody(polygonShape(obstacle.decomposed[0]),
+                        BodyTag::ObstacleTag(obstacle), true);
+      for (size_t i = 1; i < obstacle.decomposed.size(); i++) {
+        const b2PolygonShape piece = polygonShape(obstacle.decomposed[i]);
+        body->CreateFixture(&piece, 10.0f);
+      }
+    }
     body->SetTransform(toPhysVec(obstacle.pos), 0);
   }
 
+  // prop pool
+  propBodies.reserve(settings.propPoolSize);
+  idlePropBodies.reserve(settings.propPoolSize);
+  for (size_t i = 0; i < settings.propPoolSize; i++) createPropBody();
+
   // listener
   world.SetContactListener(&converter);
 
@@ -110,6 +175,9 @@ Physics::Physics(const Map &map, PhysicsListener &listener) :
 }
 
 Physics::~Physics() {
+  // Prop tags aren't ours to delete.
+  for (b2Body *body : propBodies) body->SetUserData(nullptr);
+
   for (b2Body *body = world.GetBodyList();
        body != nullptr;
        body = body->GetNext()) {
@@ -160,6 +228,46 @@ void Physics::deleteBody(b2Body *const body) {
   }
 }
 
+void Physics::createPropBody() {
+  b2BodyDef def;
+  def.type = b2_dynamicBody;
+  def.active = false;
+  def.gravityScale = 0;
+
+  const b2PolygonShape shape =
+      rectShape({settings.propSize, settings.propSize});
+  b2FixtureDef fixture;
+  fixture.shape = &shape;
+  fixture.density = 10.0f;
+  fixture.isSensor = true;
+  fixture.filter.categoryBits = propCategory;
+  fixture.filter.maskBits = uint16(~propCategory);
+
+  b2Body *body = world.CreateBody(&def);
+  body->CreateFixture(&fixture);
+  propBodies.push_back(body);
+  idlePropBodies.push_back(body);
+}
+
+b2Body *Physics::acquirePropBody(const BodyTag &tag) {
+  if (idlePropBodies.empty()) createPropBody();
+  b2Body *body = idlePropBodies.back();
+  idlePropBodies.pop_back();
+
+  body->SetUserData((void *) &tag);
+  body->SetActive(true);
+  body->SetAwake(true);
+  return body;
+}
+
+void Physics::releasePropBody(b2Body *const body) {
+  // Deactivating ends its contacts, which dispatch with the tag; so it has
+  // to be done before we forget the tag.
+  body->SetActive(false);
+  body->SetUserData(nullptr);
+  idlePropBodies.push_back(body);
+}
+
 b2PolygonShape Physics::rectShape(const sf::Vector2f &dims) {
   b2PolygonShape shape;
   const auto bdims = toPhysVec(dims);
@@ -170,32 +278,45 @@ b2PolygonShape Physics::rectShape(const sf::Vector2f &dims) {
 b2PolygonShape Physics::polygonShape(
     const std::vector<sf::Vector2f> &verticies) {
   b2PolygonShape shape;
-  b2Vec2 *points = new b2Vec2[verticies.size()];
-  size_t i = 0;
-  for (const auto &vertex : verticies) {
-    points[i] = toPhysVec(vertex);
-    ++i;
-  }
-  shape.Set(points, (int32) verticies.size());
-  delete[] points;
+  b2Vec2 points[b2_maxPolygonVertices];
+  const size_t count =
+      std::min(verticies.size(), size_t(b2_maxPolygonVertices));
+  for (size_t i = 0; i < count; ++i) points[i] = toPhysVec(verticies[i]);
+  shape.Set(points, (int32) count);
   return shape;
 }
 
 b2ChainShape Physics::chainLoopShape(
     const std::vector<sf::Vector2f> &verticies) {
   b2ChainShape shape;
-  b2Vec2 *points = new b2Vec2[verticies.size() + 1];
-  points[0] = toPhysVec(verticies[verticies.size() - 1]);
-  size_t i = 1;
-  for (const auto &vertex : verticies) {
-    points[i] = toPhysVec(vertex);
-    ++i;
-  }
-  shape.CreateChain(points, (int32) (verticies.size() + 1));
-  delete[] points;
+  std::vector<b2Vec2> points;
+  points.reserve(verticies.size() + 1);
+  points.push_back(toPhysVec(verticies.back()));
+  for (const auto &vertex : verticies) points.push_back(toPhysVec(vertex));
+  shape.CreateChain(points.data(), (int32) points.size());
   return shape;
 }
 
+float Physics::clearance(
+    const sf::Vector2f &pos,
+    const std::function<float(const BodyTag &)> &weigh,
+    const float maxDistance) const {
+  // Once the nearest body we've found is within a box's radius, nothing
+  // outside the box can be nearer; weights of at least 1 keep that true.
+  float radius = std::min(settings.clearanceStep, maxDistance);
+  while (true) {
+    NearestBodyQuery query(*this, pos, weigh, maxDistance);
+    b2AABB box;
+    box.lowerBound = toPhysVec(pos - sf::Vector2f(radius, radius));
+    box.upperBound = toPhysVec(pos + sf::Vector2f(radius, radius));
+    world.QueryAABB(&query, box);
+
+    if (query.nearest <= radius or radius >= maxDistance)
+      return query.nearest;
+    radius = std::min(radius * 2, maxDistance);
+  }
+}
+
 void Physics::approachRotVel(b2Body *body, float rotvel) const {
   body->ApplyAngularImpulse(
       body->GetInertia() * (toRad(rotvel) - body->GetAngularVelocity()),
@@ -225,6 +346,21 @@ PhysicalState::PhysicalState(const sf::Vector2f &pos,
                              const float rotvel) :
     pos(pos), vel(vel), rot(rot), rotvel(rotvel) {}
 
+PhysicalState PhysicalState::interpolate(const PhysicalState &from,
+                                         const PhysicalState &to,
+                                         const float t) {
+  // the short way around
+  const float turn = cyclicDistance(Cyclic(0, 360, from.rot), to.rot);
+  return PhysicalState(from.pos + t * (to.pos - from.pos),
+                       from.vel + t * (to.vel - from.vel),
+                       from.rot + t * turn,
+                       from.rotvel + t * (to.rotvel - from.rotvel));
+}
+
+PhysicalState PhysicalState::extrapolate(const TimeDiff delta) const {
+  return PhysicalState(pos + delta * vel, vel, rot + delta * rotvel, rotvel);
+}
+
 void PhysicalState::hardWriteToBody(const Physics &physics,
                                     b2Body *const body) const {
   body->SetLinearVelocity(physics.toPhysVec(vel));
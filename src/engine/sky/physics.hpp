@@ -91,11 +91,22 @@ class Physics {
     int velocityIterations = 8, positionIterations = 3; // simulation parameters
     float distanceScale = 100; // box2d uses meters, not px
     float gravity = 150; // reasonable default for gravity
+    float propSize = 10; // side of a prop's square hitbox, in px
+    size_t propPoolSize = 32; // prop bodies created up front
+    float clearanceStep = 100; // radius of the first clearance query, in px
   } settings;
 
   b2World world;
   PhysicsDispatcher converter;
 
+  // Prop bodies are pooled: deactivated when released, and reactivated for
+  // the next prop, so firing doesn't create and destroy bodies. They're
+  // sensors, only there to detect hits: the solver never touches them, and
+  // they don't collide with each other.
+  static constexpr uint16 propCategory = 0x0002;
+  std::vector<b2Body *> propBodies, idlePropBodies;
+  void createPropBody();
+
  public:
   Physics() = delete;
   Physics(Map &&, PhysicsListener &) = delete; // Map must not be temp!
@@ -117,11 +128,23 @@ class Physics {
                      const BodyTag &tag, bool isStatic = false);
   void deleteBody(b2Body *const body);
 
+  // Managing pooled prop bodies; the tag is owned by the caller.
+  b2Body *acquirePropBody(const BodyTag &tag);
+  void releasePropBody(b2Body *const body);
+
   // Constructing shapes.
   b2PolygonShape rectShape(const sf::Vector2f &dims);
   b2PolygonShape polygonShape(const std::vector<sf::Vector2f> &verticies);
   b2ChainShape chainLoopShape(const std::vector<sf::Vector2f> &verticies);
 
+  // Distance from pos to the nearest body, times weigh(body's tag) -- which
+  // is 0 for bodies to ignore, or at least 1 -- and at most maxDistance.
+  // Searches outwards through the broadphase, so it's cheap when something
+  // is close.
+  float clearance(const sf::Vector2f &pos,
+                  const std::function<float(const BodyTag &)> &weigh,
+                  const float maxDistance) const;
+
   // Impulses.
   void approachRotVel(b2Body *body, float rotvel) const;
   void approachVel(b2Body *body, sf::Vector2f vel) const;
@@ -141,13 +164,22 @@ struct PhysicalState {
 
   template<typename Archive>
   void serialize(Archive &ar) {
-    ar(pos, vel, rot, rotvel);
+    tg::pack(ar, nullptr, pos, tg::Quantum::Position);
+    tg::pack(ar, nullptr, vel, tg::Quantum::Velocity);
+    ar(rot);
+    tg::pack(ar, nullptr, rotvel, tg::Quantum::AngularVelocity);
   }
 
   sf::Vector2f pos, vel;
   Angle rot;
   float rotvel;
 
+  // Blending, for display between snapshots.
+  static PhysicalState interpolate(const PhysicalState &from,
+                                   const PhysicalState &to,
+                                   const float t);
+  PhysicalState extrapolate(const TimeDiff delta) const;
+
   void hardWriteToBody(const Physics &physics, b2Body *const body) const;
   void writeToBody(const Physics &physics, b2Body *const body) const;
   void readFromBody(const Physics &physics, const b2Body *const body);
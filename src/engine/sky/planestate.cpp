@@ -15,6 +15,7 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <cmath>
 #include "planestate.hpp"
 #include "util/methods.hpp"
 
@@ -200,6 +201,87 @@ void PlaneState::applyServer(const PlaneStateServer &server) {
   primaryCooldown.cooldown = server.primaryCooldown;
 }
 
+/**
+ * PlaneStateDelta.
+ */
+
+namespace {
+
+// How far a field can drift from what the clients have before it's sent.
+const float positionTolerance = 0.05;
+const float velocityTolerance = 0.1;
+const float angleTolerance = 0.01;
+const float unitTolerance = 0.001;
+
+template<typename T>
+void diffField(optional<T> &field, const T &reference, const T &value,
+               const float tolerance) {
+  if (std::abs(float(value) - float(reference)) > tolerance)
+    field.emplace(value);
+}
+
+void diffField(optional<sf::Vector2f> &field,
+               const sf::Vector2f &reference, const sf::Vector2f &value,
+               const float tolerance) {
+  if (VecMath::length(value - reference) > tolerance)
+    field.emplace(value);
+}
+
+}
+
+PlaneStateDelta::PlaneStateDelta(const PlaneState &reference,
+                                 const PlaneState &state) {
+  const auto &refPhys = reference.physical, &phys = state.physical;
+  diffField(pos, refPhys.pos, phys.pos, positionTolerance);
+  diffField(vel, refPhys.vel, phys.vel, velocityTolerance);
+  const float rotDiff = std::abs(float(phys.rot) - float(refPhys.rot));
+  if (std::min(rotDiff, 360 - rotDiff) > angleTolerance) rot = phys.rot;
+  diffField(rotvel, refPhys.rotvel, phys.rotvel, angleTolerance);
+
+  if (state.stalled != reference.stalled) stalled = state.stalled;
+  diffField(airspeed, reference.airspeed, state.airspeed, unitTolerance);
+  diffField(afterburner, reference.afterburner, state.afterburner,
+            unitTolerance);
+  diffField(throttle, reference.throttle, state.throttle, unitTolerance);
+  diffField(leftoverVel, reference.leftoverVel, state.leftoverVel,
+            velocityTolerance);
+
+  diffField(energy, reference.energy, state.energy, unitTolerance);
+  diffField(health, reference.health, state.health, unitTolerance);
+  diffField(primaryCooldown, reference.primaryCooldown.cooldown,
+            state.primaryCooldown.cooldown, unitTolerance);
+}
+
+bool PlaneStateDelta::isEmpty() const {
+  return !(pos || vel || rot || rotvel || stalled || airspeed || afterburner
+      || throttle || leftoverVel || energy || health || primaryCooldown);
+}
+
+void PlaneStateDelta::apply(PlaneState &state) const {
+  if (pos) state.physical.pos = *pos;
+  if (vel) state.physical.vel = *vel;
+  if (rot) state.physical.rot = *rot;
+  if (rotvel) state.physical.rotvel = *rotvel;
+
+  if (stalled) state.stalled = *stalled;
+  if (airspeed) state.airspeed = *airspeed;
+  if (afterburner) state.afterburner = *afterburner;
+  if (throttle) state.throttle = *throttle;
+  if (leftoverVel) state.leftoverVel = *leftoverVel;
+
+  if (energy) state.energy = *energy;
+  if (health) state.health = *health;
+  if (primaryCooldown) state.primaryCooldown.cooldown = *primaryCooldown;
+}
+
+PlaneStateDelta PlaneStateDelta::respectClientAuthority() const {
+  PlaneStateDelta delta;
+  delta.energy = energy;
+  delta.health = health;
+  delta.primaryCooldown = primaryCooldown;
+  return delta;
+}
+
 /**
  * PlaneControls.
  */
@@ -169,7 +169,8 @@ struct PlaneState {
 
   template<class Archive>
   void serialize(Archive &ar) {
-    ar(physical, stalled, airspeed, afterburner, throttle, leftoverVel);
+    ar(physical, stalled, airspeed, afterburner, throttle);
+    tg::pack(ar, nullptr, leftoverVel, tg::Quantum::Velocity);
     ar(energy, health, primaryCooldown);
   }
 
@@ -192,6 +193,47 @@ struct PlaneState {
 
 };
 
+/**
+ * The fields of a PlaneState that changed noticeably since a reference
+ * state. Used in ParticipationDelta so unchanged fields stay off the wire.
+ *
+ * The reference is the last keyframe every client was sent reliably, not a
+ * state each client acked, so one encoded delta serves everyone. A moving
+ * plane's delta still carries its motion every time, and drifts towards the
+ * whole state as the keyframe ages; BM_SkyDeltaSize measures the difference.
+ */
+struct PlaneStateDelta {
+  PlaneStateDelta() = default;
+  PlaneStateDelta(const PlaneState &reference, const PlaneState &state);
+
+  template<class Archive>
+  void serialize(Archive &ar) {
+    packOptional(ar, pos, tg::Quantum::Position);
+    packOptional(ar, vel, tg::Quantum::Velocity);
+    ar(rot);
+    packOptional(ar, rotvel, tg::Quantum::AngularVelocity);
+    ar(stalled, airspeed, afterburner, throttle);
+    packOptional(ar, leftoverVel, tg::Quantum::Velocity);
+    ar(energy, health, primaryCooldown);
+  }
+
+  optional<sf::Vector2f> pos, vel;
+  optional<Angle> rot;
+  optional<float> rotvel;
+  optional<bool> stalled;
+  optional<Clamped> airspeed, afterburner, throttle;
+  optional<sf::Vector2f> leftoverVel;
+
+  optional<Clamped> energy, health;
+  optional<float> primaryCooldown;
+
+  bool isEmpty() const;
+  void apply(PlaneState &state) const;
+  // Only keep the fields a server has authority over.
+  PlaneStateDelta respectClientAuthority() const;
+
+};
+
 /**
  * The persistent control state of a Participation; synchronized along with the
  * rest of the Participation's state.
@@ -35,7 +35,12 @@ PropInit::PropInit(const sf::Vector2f &pos, const sf::Vector2f &vel) :
  */
 
 void Prop::writeToBody() {
-  physical.writeToBody(physics, body);
+  // Nothing pushes a prop around but its own velocity, so the body only
+  // needs writing when a delta has moved it.
+  if (bodyOutdated) {
+    physical.hardWriteToBody(physics, body);
+    bodyOutdated = false;
+  }
 }
 
 void Prop::readFromBody() {
@@ -51,15 +56,20 @@ Prop::Prop(const PID associatedPlayer,
            const PropInit &initializer) :
     Networked(initializer),
     physics(physics),
-    body(physics.createBody(physics.rectShape({10, 10}),
-                            BodyTag::PropTag(*this))),
+    tag(BodyTag::PropTag(*this)),
+    body(physics.acquirePropBody(tag)),
     physical(initializer.physical),
     lifetime(0),
     destroyable(false),
+    bodyOutdated(false),
+    spawnTime(0),
     newlyAlive(true),
     associatedPlayer(associatedPlayer) {
   physical.hardWriteToBody(physics, body);
-  body->SetGravityScale(0);
+}
+
+Prop::~Prop() {
+  physics.releasePropBody(body);
 }
 
 PropInit Prop::captureInitializer() const {
@@ -70,6 +80,7 @@ PropInit Prop::captureInitializer() const {
 
 void Prop::applyDelta(const PropDelta &delta) {
   physical = delta.physical;
+  bodyOutdated = true;
 }
 
 PropDelta Prop::collectDelta() {
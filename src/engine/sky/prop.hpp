@@ -63,10 +63,13 @@ class Prop: public Networked<PropInit, PropDelta> {
  private:
   // State.
   Physics &physics;
-  b2Body *const body; // sorry, we need this r beucabecause box2d
+  const BodyTag tag;
+  b2Body *const body; // pooled by Physics
   PhysicalState physical;
   float lifetime;
   bool destroyable;
+  bool bodyOutdated; // physical was changed by a delta
+  Time spawnTime; // server uptime of the SpawnProps it came in, on clients
 
   // Delta collection state, for Participation.
   bool newlyAlive;
@@ -81,6 +84,8 @@ class Prop: public Networked<PropInit, PropDelta> {
   Prop(const PID associatedPlayer,
        Physics &physics,
        const PropInit &initializer);
+  Prop(const Prop &) = delete;
+  ~Prop();
 
   const PID associatedPlayer;
 
@@ -15,11 +15,22 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <limits>
 #include "sky.hpp"
 #include "util/printer.hpp"
 
 namespace sky {
 
+namespace {
+
+// Enemies further than this from a spawn point don't matter.
+const float spawnSafeDistance = 1000;
+
+// A friendly plane this many times closer counts as much as an enemy.
+const float friendlySpawnWeight = 4;
+
+}
+
 /**
  * SkyInit.
  */
@@ -39,23 +50,38 @@ bool SkyDelta::verifyStructure() const {
   return verifyMap(participations) and verifyOptionals(settings);
 }
 
-SkyDelta SkyDelta::respectAuthority(const Player &player) const {
-  SkyDelta newDelta;
-  newDelta.settings = settings;
-
-  for (auto pDelta : participations) {
-    if (pDelta.first == player.pid) {
-      newDelta.participations.emplace(
-          pDelta.first,
-          pDelta.second.respectClientAuthority());
-    } else {
-      newDelta.participations.emplace(pDelta.first, pDelta.second);
-    }
+bool SkyDelta::needsReliable() const {
+  if (settings) return true;
+  for (const auto &participation : participations) {
+    if (participation.second.needsReliable()) return true;
   }
+  return false;
+}
 
+SkyDelta SkyDelta::respectAuthority(const Player &player) const {
+  SkyDelta newDelta{*this};
+  const auto own = newDelta.participations.find(player.pid);
+  if (own != newDelta.participations.end())
+    own->second = own->second.respectClientAuthority();
   return newDelta;
 }
 
+/**
+ * SkyPropSpawns.
+ */
+
+bool SkyPropSpawns::isEmpty() const {
+  return props.empty();
+}
+
+void SkyPropSpawns::merge(const SkyPropSpawns &later) {
+  for (const auto &participation : later.props) {
+    auto &merged = props[participation.first];
+    for (const auto &prop : participation.second)
+      merged[prop.first] = prop.second;
+  }
+}
+
 /**
  * Sky.
  */
@@ -80,7 +106,10 @@ void Sky::unregisterPlayer(Player &player) {
 void Sky::onTick(const TimeDiff delta) {
   for (auto &p: participations) p.second.prePhysics();
   physics.tick(delta);
-  for (auto &p: participations) p.second.postPhysics(delta);
+  for (auto &p: participations) {
+    p.second.postPhysics(delta);
+    p.second.recordHistory(arena.getUptime());
+  }
 }
 
 void Sky::onAction(Player &player, const Action action, const bool state) {
@@ -95,10 +124,13 @@ void Sky::onSpawn(Player &player,
 }
 
 void Sky::onBeginContact(const BodyTag &body1, const BodyTag &body2) {
-  if (body1.type == BodyTag::Type::PlaneTag)
-    body1.plane->onBeginContact(body2);
-  if (body2.type == BodyTag::Type::PlaneTag)
-    body2.plane->onBeginContact(body1);
+  // planes only react to contacts no subsystem has disabled
+  if (enableContact(body1, body2)) {
+    if (body1.type == BodyTag::Type::PlaneTag)
+      body1.plane->onBeginContact(body2);
+    if (body2.type == BodyTag::Type::PlaneTag)
+      body2.plane->onBeginContact(body1);
+  }
 
   for (auto s : arena.subsystems) {
     if (s.second != this)
@@ -137,7 +169,8 @@ Sky::Sky(Arena &arena, const Map &map, const SkyInit &initializer) :
     Networked(initializer),
     map(map),
     physics(map, *this),
-    settings(initializer.settings) {
+    settings(initializer.settings),
+    deltasSinceKeyframe(0) {
   arena.forPlayers([&](Player &player) {
     const auto iter = initializer.participations.find(player.pid);
     registerPlayerWith(
@@ -151,16 +184,30 @@ Sky::Sky(Arena &arena, const Map &map, const SkyInit &initializer) :
 }
 
 void Sky::applyDelta(const SkyDelta &delta) {
+  applyDelta(delta, std::numeric_limits<Time>::infinity());
+}
+
+void Sky::applyDelta(const SkyDelta &delta, const Time timestamp) {
   for (const auto &participation: delta.participations) {
     if (const Player *player = arena.getPlayer(participation.first)) {
-      getPlayerData(*player).applyDelta(participation.second);
+      getPlayerData(*player).applyDelta(participation.second, timestamp);
     }
   }
   settings.applyDelta(delta.settings.get());
 }
 
+void Sky::applyLateDelta(const SkyDelta &delta) {
+  for (const auto &participation: delta.participations) {
+    if (const Player *player = arena.getPlayer(participation.first)) {
+      getPlayerData(*player).applyLateDelta(participation.second);
+    }
+  }
+  if (delta.settings) settings.applyDelta(delta.settings.get());
+}
+
 SkyInit Sky::captureInitializer() const {
   SkyInit initializer;
+  initializer.dimensions = map.getDimensions();
   for (const auto &participation : participations)
     initializer.participations.emplace(
         participation.first, participation.second.captureInitializer());
@@ -170,18 +217,74 @@ SkyInit Sky::captureInitializer() const {
 
 SkyDelta Sky::collectDelta() {
   SkyDelta delta;
+  // keyframes for every participation at once, so few deltas go reliably
+  const bool keyframe = ++deltasSinceKeyframe >= keyframeInterval;
+  if (keyframe) deltasSinceKeyframe = 0;
   for (auto &participation : participations) {
     delta.participations.emplace(
-        participation.first, participation.second.collectDelta());
+        participation.first, participation.second.collectDelta(keyframe));
   }
   delta.settings = settings.collectDelta();
   return delta;
 }
 
+SkyPropSpawns Sky::collectPropSpawns() {
+  SkyPropSpawns spawns;
+  for (auto &participation : participations) {
+    auto props = participation.second.collectPropSpawns();
+    if (!props.empty())
+      spawns.props.emplace(participation.first, std::move(props));
+  }
+  return spawns;
+}
+
+void Sky::applyPropSpawns(const SkyPropSpawns &spawns, const Time timestamp) {
+  for (const auto &participation : spawns.props) {
+    if (const Player *player = arena.getPlayer(participation.first)) {
+      getPlayerData(*player).applyPropSpawns(participation.second, timestamp);
+    }
+  }
+}
+
+void Sky::pruneDeadProps(SkyPropSpawns &spawns) const {
+  auto participation = spawns.props.begin();
+  while (participation != spawns.props.end()) {
+    const Player *player = arena.getPlayer(participation->first);
+    if (player) {
+      const auto &alive = getPlayerData(*player).props;
+      auto prop = participation->second.begin();
+      while (prop != participation->second.end()) {
+        if (alive.count(prop->first)) ++prop;
+        else prop = participation->second.erase(prop);
+      }
+    }
+    if (!player or participation->second.empty())
+      participation = spawns.props.erase(participation);
+    else ++participation;
+  }
+}
+
 const Map &Sky::getMap() const {
   return map;
 }
 
+SpawnPoint Sky::pickSpawnPoint(const Player &player) const {
+  const Team team = player.getTeam();
+  const auto weighPlane = [&](const BodyTag &tag) -> float {
+    if (tag.type != BodyTag::Type::PlaneTag
+        or tag.plane->associatedPlayer == player.pid)
+      return 0;
+    const Player *other = arena.getPlayer(tag.plane->associatedPlayer);
+    if (!other) return 0;
+    return (team != Team::Spectator and other->getTeam() == team) ?
+           friendlySpawnWeight : 1;
+  };
+
+  return map.pickSpawnPoint(team, [&](const sf::Vector2f &pos) {
+    return physics.clearance(pos, weighPlane, spawnSafeDistance);
+  });
+}
+
 Participation &Sky::getParticipation(const Player &player) const {
   return getPlayerData(player);
 }
@@ -36,18 +36,23 @@ struct SkyInit : public VerifyStructure {
 
   template<typename Archive>
   void serialize(Archive &ar) {
+    ar(dimensions);
+    tg::setPackingBounds(ar, dimensions);
     ar(settings, participations);
   }
 
   bool verifyStructure() const;
 
+  sf::Vector2f dimensions; // map dimensions, for packing
   SkySettingsInit settings;
   std::map<PID, ParticipationInit> participations;
 
 };
 
 /**
- * Delta for Sky. Broadcast by server, applied by clients.
+ * Delta for Sky. Broadcast by server, applied by clients. Positions are
+ * packed against the map dimensions both ends' Telegraphs took from the
+ * SkyInit.
  */
 struct SkyDelta : public VerifyStructure {
   SkyDelta();
@@ -58,15 +63,38 @@ struct SkyDelta : public VerifyStructure {
   }
 
   bool verifyStructure() const;
+  bool needsReliable() const;
 
   optional<SkySettingsDelta> settings;
   std::map<PID, ParticipationDelta> participations;
 
-  // Transform to respect client authority.
+  // Transform to respect client authority; applied by the receiving client,
+  // so the server can encode one delta for everyone.
   SkyDelta respectAuthority(const Player &player) const;
 
 };
 
+/**
+ * Props spawned in a Sky since they were last collected, by participation.
+ * They go reliably on their own, so the SkyDeltas around them can be lost;
+ * packed like them.
+ */
+struct SkyPropSpawns {
+  SkyPropSpawns() = default;
+
+  template<typename Archive>
+  void serialize(Archive &ar) {
+    ar(props);
+  }
+
+  bool isEmpty() const;
+  // Add later spawns; a prop PID spawned again takes its newer init.
+  void merge(const SkyPropSpawns &later);
+
+  std::map<PID, std::map<PID, PropInit>> props;
+
+};
+
 /**
  * Game world when a game is in session.
  */
@@ -81,9 +109,12 @@ class Sky : public PhysicsListener,
 
   // State.
   Physics physics;
-  std::map<PID, Participation> participations;
+  SlotMap<Participation> participations;
   SkySettings settings;
 
+  // Delta collection state.
+  unsigned int deltasSinceKeyframe;
+
  protected:
   void registerPlayerWith(Player &player,
                           const ParticipationInit &initializer);
@@ -115,13 +146,31 @@ class Sky : public PhysicsListener,
       std::map<PID, optional<Participation>> &) = delete; // Map can't be temp
   Sky(Arena &arena, const Map &map, const SkyInit &initializer);
 
+  // Every this many deltas, whole plane states are sent reliably, so
+  // clients recover from lost snapshots. Snapshots are relative to the last
+  // keyframe, not to what each client acked, so one encoding serves
+  // everyone; they grow as planes drift from it, and a client still
+  // waiting on a keyframe skips snapshots until it arrives.
+  static constexpr unsigned int keyframeInterval = 30;
+
   // Networked impl.
   void applyDelta(const SkyDelta &delta) override final;
+  // A delta collected at a server time, not erasing props spawned since.
+  void applyDelta(const SkyDelta &delta, const Time timestamp);
+  // A reliable delta older than one already applied.
+  void applyLateDelta(const SkyDelta &delta);
   SkyInit captureInitializer() const override final;
   SkyDelta collectDelta();
+  SkyPropSpawns collectPropSpawns();
+  void applyPropSpawns(const SkyPropSpawns &spawns, const Time timestamp);
+  // Drop the spawns of props that have died since.
+  void pruneDeadProps(SkyPropSpawns &spawns) const;
 
   // User API.
   const Map &getMap() const;
+  // The spawn point for a player's team furthest from enemy planes, and
+  // less strongly from friendly ones.
+  SpawnPoint pickSpawnPoint(const Player &player) const;
   Participation &getParticipation(const Player &player) const;
   const SkySettings &getSettings() const;
   void changeSettings(const SkySettingsDelta &delta);
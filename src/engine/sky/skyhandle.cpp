@@ -24,6 +24,15 @@ namespace sky {
  * SkyHandle.
  */
 
+void SkyHandle::useEnvironment(const EnvironmentURL &url) {
+  // The old Sky refers to the old environment's map, so it goes first.
+  sky.reset();
+  // Restarting on the same map keeps its loaded (and decomposed) geometry.
+  if (!environment or environment->url != url
+      or environment->loadingErrored())
+    environment.emplace(url);
+}
+
 SkyHandle::SkyHandle(Arena &arena, const SkyHandleInit &initializer) :
     Subsystem(arena),
     Networked(initializer),
@@ -69,7 +78,7 @@ optional<SkyHandleDelta> SkyHandle::collectDelta() {
 
 void SkyHandle::applyDelta(const SkyHandleDelta &delta) {
   if (delta) {
-    environment.emplace(delta.get());
+    useEnvironment(delta.get());
     caller.doStartGame();
   } else {
     sky.reset();
@@ -80,7 +89,7 @@ void SkyHandle::applyDelta(const SkyHandleDelta &delta) {
 
 void SkyHandle::start() {
   envStateIsNew = true;
-  environment.emplace(arena.getNextEnv());
+  useEnvironment(arena.getNextEnv());
   caller.doStartGame();
 }
 
@@ -93,7 +102,7 @@ void SkyHandle::instantiateSky(const SkyInit &init) {
 
 void SkyHandle::stop() {
   envStateIsNew = true;
-  environment.reset();
+  environment.reset(); // cancels any loading it's still doing
   sky.reset();
   caller.doEndGame();
 }
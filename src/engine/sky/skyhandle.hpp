@@ -42,6 +42,9 @@ class SkyHandle
   // Delta collection state.
   bool envStateIsNew;
 
+  // Helpers.
+  void useEnvironment(const EnvironmentURL &url);
+
  public:
   SkyHandle(class Arena &parent, const SkyHandleInit &initializer);
 
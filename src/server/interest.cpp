@@ -0,0 +1,218 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include "interest.hpp"
+
+/**
+ * InterestSettings.
+ */
+
+InterestSettings::InterestSettings() :
+    cellSize(400),
+    viewMargin(300),
+    leaveMargin(500),
+    distantInterval(8) { }
+
+/**
+ * InterestGrid.
+ */
+
+size_t InterestGrid::column(const float x) const {
+  return size_t(clamp(0.0f, float(columns - 1), std::floor(x / cellSize)));
+}
+
+size_t InterestGrid::row(const float y) const {
+  return size_t(clamp(0.0f, float(rows - 1), std::floor(y / cellSize)));
+}
+
+InterestGrid::InterestGrid(const sf::Vector2f &dimensions,
+                           const float cellSize) :
+    cellSize(cellSize),
+    columns(std::max(size_t(1), size_t(std::ceil(dimensions.x / cellSize)))),
+    rows(std::max(size_t(1), size_t(std::ceil(dimensions.y / cellSize)))),
+    cells(columns * rows),
+    dimensions(dimensions) { }
+
+void InterestGrid::clear() {
+  for (auto &cell : cells) cell.clear();
+}
+
+void InterestGrid::insert(const PID pid, const sf::Vector2f &pos) {
+  cells[row(pos.y) * columns + column(pos.x)].emplace_back(pid, pos);
+}
+
+void InterestGrid::query(const sf::FloatRect &area,
+                         std::vector<PID> &pids) const {
+  // planes off the map are in the edge cells; so are the areas
+  const size_t left = column(area.left),
+      right = column(area.left + area.width),
+      top = row(area.top),
+      bottom = row(area.top + area.height);
+  for (size_t y = top; y <= bottom; y++) {
+    for (size_t x = left; x <= right; x++) {
+      for (const auto &plane : cells[y * columns + x]) {
+        if ((x == left or x == right or y == top or y == bottom)
+            and !area.contains(plane.second)) continue;
+        pids.push_back(plane.first);
+      }
+    }
+  }
+}
+
+/**
+ * InterestTracker.
+ */
+
+void InterestTracker::registerPlayer(sky::Player &player) {
+  interests.emplace(std::piecewise_construct,
+                    std::forward_as_tuple(player.pid),
+                    std::forward_as_tuple());
+  setPlayerData(player, interests.find(player.pid)->second);
+}
+
+void InterestTracker::unregisterPlayer(sky::Player &player) {
+  interests.erase(interests.find(player.pid));
+}
+
+InterestTracker::InterestTracker(sky::Arena &arena,
+                                 const InterestSettings &settings) :
+    sky::Subsystem<PlayerInterest>(arena),
+    updates(0),
+    settings(settings) {
+  arena.forPlayers([&](sky::Player &player) {
+    registerPlayer(player);
+  });
+}
+
+sf::FloatRect InterestTracker::viewArea(const sf::Vector2f &pos,
+                                        const sf::Vector2f &dimensions,
+                                        const float viewScale) {
+  // SkyRender::findView, in both dimensions
+  const auto findView = [](const float viewWidth, const float totalWidth,
+                           const float viewTarget) {
+    if (totalWidth < viewWidth) return (totalWidth - viewWidth) / 2;
+    if (viewTarget - (viewWidth / 2) < 0) return 0.0f;
+    if (viewTarget + (viewWidth / 2) > totalWidth)
+      return totalWidth - viewWidth;
+    return viewTarget - (viewWidth / 2);
+  };
+  const sf::Vector2f size(1600 / viewScale, 900 / viewScale);
+  return {findView(size.x, dimensions.x, pos.x),
+          findView(size.y, dimensions.y, pos.y), size.x, size.y};
+}
+
+void InterestTracker::update(const sky::Sky &sky) {
+  ++updates;
+  const sf::Vector2f &dimensions = sky.getMap().getDimensions();
+  if (!grid or grid->dimensions != dimensions)
+    grid.emplace(dimensions, settings.cellSize);
+
+  grid->clear();
+  spawned.clear();
+  arena.forPlayers([&](sky::Player &player) {
+    const auto &participation = sky.getParticipation(player);
+    if (participation.isSpawned()) {
+      grid->insert(player.pid,
+                   participation.plane->getState().physical.pos);
+      spawned.push_back(player.pid);
+    }
+  });
+
+  const auto widen = [](sf::FloatRect area, const float margin) {
+    area.left -= margin;
+    area.top -= margin;
+    area.width += 2 * margin;
+    area.height += 2 * margin;
+    return area;
+  };
+
+  std::vector<PID> near, staying, kept;
+  arena.forPlayers([&](sky::Player &player) {
+    auto &interest = getPlayerData(player);
+    const auto &participation = sky.getParticipation(player);
+
+    near.clear();
+    if (participation.isSpawned()) {
+      const sf::FloatRect view = viewArea(
+          participation.plane->getState().physical.pos, dimensions,
+          sky.getSettings().viewScale);
+      grid->query(widen(view, settings.viewMargin), near);
+      std::sort(near.begin(), near.end());
+
+      // planes we were already near stay until they're well clear
+      staying.clear();
+      kept.clear();
+      grid->query(widen(view, settings.leaveMargin), staying);
+      std::sort(staying.begin(), staying.end());
+      std::set_intersection(staying.begin(), staying.end(),
+                            interest.near.begin(), interest.near.end(),
+                            std::back_inserter(kept));
+      staying.clear();
+      std::set_union(near.begin(), near.end(), kept.begin(), kept.end(),
+                     std::back_inserter(staying));
+      near.swap(staying);
+    } else {
+      near = spawned; // no telling where they're looking
+      std::sort(near.begin(), near.end());
+    }
+
+    interest.entered.clear();
+    interest.left.clear();
+    std::set_difference(near.begin(), near.end(),
+                        interest.near.begin(), interest.near.end(),
+                        std::back_inserter(interest.entered));
+    std::set_difference(interest.near.begin(), interest.near.end(),
+                        near.begin(), near.end(),
+                        std::back_inserter(interest.left));
+    interest.near.swap(near);
+  });
+}
+
+const PlayerInterest &InterestTracker::getInterest(
+    const sky::Player &player) const {
+  return getPlayerData(player);
+}
+
+std::vector<PID> InterestTracker::selectParticipations(
+    const sky::Player &player, const sky::SkyDelta &delta,
+    const bool distant) const {
+  const auto &near = getPlayerData(player).near;
+  std::vector<PID> pids;
+  for (const auto &participation : delta.participations) {
+    const PID pid = participation.first;
+    // without a plane there's little to send, but a death has to arrive
+    if (pid == player.pid
+        or participation.second.needsReliable()
+        or !participation.second.planeAlive
+        or std::binary_search(near.begin(), near.end(), pid)
+        or (distant and (updates + pid) % settings.distantInterval == 0))
+      pids.push_back(pid);
+  }
+  return pids;
+}
+
+sky::SkyDelta InterestTracker::filter(const sky::SkyDelta &delta,
+                                      const std::vector<PID> &participations) {
+  sky::SkyDelta filtered;
+  filtered.settings = delta.settings;
+  for (const PID pid : participations)
+    filtered.participations.emplace(pid, delta.participations.at(pid));
+  return filtered;
+}
@@ -0,0 +1,113 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Interest management, so clients get frequent sky deltas only for the
+ * participations near them.
+ */
+#pragma once
+#include <SFML/Graphics/Rect.hpp>
+#include "engine/arena.hpp"
+#include "engine/sky/sky.hpp"
+#include "util/types.hpp"
+
+/**
+ * Tuning for InterestTracker.
+ */
+struct InterestSettings {
+  InterestSettings(); // sensible defaults
+
+  float cellSize; // of the grid over the map
+  float viewMargin; // around a client's view, for planes about to enter it
+  float leaveMargin; // wider, so planes on the edge don't flicker in and out
+  unsigned int distantInterval; // distant ones go in one delta of this many
+
+};
+
+/**
+ * Grid over a map, bucketing planes by position.
+ */
+class InterestGrid {
+ private:
+  float cellSize;
+  size_t columns, rows;
+  std::vector<std::vector<std::pair<PID, sf::Vector2f>>> cells;
+
+  size_t column(const float x) const;
+  size_t row(const float y) const;
+
+ public:
+  InterestGrid(const sf::Vector2f &dimensions, const float cellSize);
+
+  const sf::Vector2f dimensions;
+
+  void clear(); // keeps the buckets' memory
+  void insert(const PID pid, const sf::Vector2f &pos);
+  // Append the pids in an area to `pids`, in no particular order.
+  void query(const sf::FloatRect &area, std::vector<PID> &pids) const;
+
+};
+
+/**
+ * What a player is interested in: the planes in or around their view, as
+ * of the last update, in order.
+ */
+struct PlayerInterest {
+  std::vector<PID> near;
+  std::vector<PID> entered, left; // changes in the last update
+};
+
+/**
+ * Subsystem tracking every player's interest, and filtering sky deltas
+ * for them.
+ */
+class InterestTracker: public sky::Subsystem<PlayerInterest> {
+ private:
+  std::map<PID, PlayerInterest> interests;
+  optional<InterestGrid> grid;
+  std::vector<PID> spawned; // as of the last update
+  unsigned long updates;
+
+ protected:
+  void registerPlayer(sky::Player &player) override final;
+  void unregisterPlayer(sky::Player &player) override final;
+
+ public:
+  InterestTracker(sky::Arena &arena,
+                  const InterestSettings &settings = {});
+
+  const InterestSettings settings;
+
+  // Area a player sees, as SkyRender frames it.
+  static sf::FloatRect viewArea(const sf::Vector2f &pos,
+                                const sf::Vector2f &dimensions,
+                                const float viewScale);
+
+  // Recompute everyone's interest in a sky, once per delta sent.
+  void update(const sky::Sky &sky);
+  const PlayerInterest &getInterest(const sky::Player &player) const;
+
+  // The participations of a delta to send to a player: their own, the ones
+  // that have to go reliably, the near ones, and (with `distant`) the
+  // distant ones whose turn it is.
+  std::vector<PID> selectParticipations(const sky::Player &player,
+                                        const sky::SkyDelta &delta,
+                                        const bool distant = true) const;
+  static sky::SkyDelta filter(const sky::SkyDelta &delta,
+                              const std::vector<PID> &participations);
+
+};
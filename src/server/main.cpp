@@ -18,16 +18,27 @@
 /**
  * Server top-level.
  */
-#include "server.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include "multiserver.hpp"
 #include "servers/vanilla.hpp"
 
-int main() {
-  // TODO: commandline arguments
+int main(int argc, char **argv) {
+  // TODO: proper commandline arguments
+  // solemnsky_server [arena count], each arena on its own port from 4242
+  const int arenaCount = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 1;
+
+  std::vector<ArenaSpec> arenas;
+  for (int i = 0; i < arenaCount; i++) {
+    const std::string name = "my special server"
+        + ((i == 0) ? std::string() : " " + std::to_string(i + 1));
+    arenas.emplace_back(Port(4242 + i), sky::ArenaInit(name, "asteroids"));
+  }
 
   // and He said,
-  ServerExec(4242, sky::ArenaInit("my special server", "asteroids"),
-             [](ServerShared &shared) {
-               return std::make_unique<VanillaServer>(shared);
+  MultiServer(arenas,
+              [](ServerShared &shared) {
+                return std::make_unique<VanillaServer>(shared);
       }).run();
   // and lo, there appeared a server
 }
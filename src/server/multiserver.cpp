@@ -0,0 +1,72 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "multiserver.hpp"
+
+/**
+ * ArenaSpec.
+ */
+
+ArenaSpec::ArenaSpec(const Port port, const sky::ArenaInit &arenaInit) :
+    port(port), arenaInit(arenaInit) { }
+
+/**
+ * MultiServer.
+ */
+
+MultiServer::MultiServer(
+    const std::vector<ArenaSpec> &arenas,
+    std::function<std::unique_ptr<ServerListener>(
+        ServerShared &)> mkServer,
+    const ServerLoopSettings &loopSettings) {
+  ArenaDirectory directory;
+  for (const auto &arena : arenas) {
+    if (!directory.emplace(arena.arenaInit.name, arena.port).second)
+      throw std::runtime_error(
+          "Arena name used twice: " + inQuotes(arena.arenaInit.name));
+  }
+
+  // Execs are constructed here, so failures (like a port in use) surface
+  // before any worker starts; each is only touched by its worker after that.
+  for (const auto &arena : arenas) {
+    execs.emplace_back(std::make_unique<ServerExec>(
+        arena.port, arena.arenaInit, mkServer, loopSettings, directory));
+  }
+}
+
+MultiServer::~MultiServer() {
+  stop();
+  for (auto &worker : workers) {
+    if (worker.joinable()) worker.join();
+  }
+}
+
+void MultiServer::run() {
+  for (auto &exec : execs) {
+    ServerExec *const ptr = exec.get();
+    workers.emplace_back([ptr]() { ptr->run(); });
+  }
+  appLog("Hosting " + std::to_string(execs.size()) + " arenas.",
+         LogOrigin::Server);
+
+  for (auto &worker : workers) worker.join();
+  workers.clear();
+}
+
+void MultiServer::stop() {
+  for (auto &exec : execs) exec->running = false;
+}
@@ -0,0 +1,66 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Hosting several arenas in one server process.
+ */
+#pragma once
+#include "server.hpp"
+#include "util/threads.hpp"
+
+/**
+ * An arena for a MultiServer to host, and the port it listens on.
+ */
+struct ArenaSpec {
+  ArenaSpec(const Port port, const sky::ArenaInit &arenaInit);
+
+  Port port;
+  sky::ArenaInit arenaInit;
+
+};
+
+/**
+ * Runs a ServerExec for each of a number of arenas, each on its own port and
+ * its own worker thread, so one process can use every core of the machine.
+ * Clients asking any of them for a sibling arena at ReqJoin are redirected.
+ *
+ * The arenas load their environments at the same time, through the
+ * process-wide component caches and loader pool; nothing on that path may
+ * depend on process-wide state like the working directory.
+ */
+class MultiServer {
+ private:
+  tg::UsageFlag flag; // for enet global state, shared by the workers
+
+  std::vector<std::unique_ptr<ServerExec>> execs;
+  std::vector<std::thread> workers;
+
+ public:
+  MultiServer(const std::vector<ArenaSpec> &arenas,
+              std::function<std::unique_ptr<ServerListener>(
+                  ServerShared &)> mkServer,
+              const ServerLoopSettings &loopSettings = {});
+  MultiServer(const MultiServer &) = delete;
+  MultiServer &operator=(const MultiServer &) = delete;
+  ~MultiServer();
+
+  // Start the workers, and wait for all of them to stop.
+  void run();
+  // Ask every worker to stop; safe from any thread.
+  void stop();
+
+};
@@ -0,0 +1,137 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ratecontrol.hpp"
+
+/**
+ * RateControlSettings.
+ */
+
+RateControlSettings::RateControlSettings() :
+    minInterval(0.03), // the rate we collect sky deltas at
+    maxInterval(0.24),
+    recoveryStep(0.01),
+    maxQueueing(0.15),
+    roundTripWindow(60), // half a minute of adaptations
+    maxLoss(0.05),
+    minThrottle(0.5),
+    maxReliableInTransit(16384) { }
+
+/**
+ * PlayerRate.
+ */
+
+PlayerRate::PlayerRate(const TimeDiff interval,
+                       const unsigned int roundTripWindow) :
+    snapshotTimer(interval),
+    roundTrips(roundTripWindow) {
+  snapshotTimer.prime();
+}
+
+/**
+ * RateControl.
+ */
+
+bool RateControl::isCongested(const PlayerRate &rate,
+                              const tg::PeerStats &stats) const {
+  // only measured round trips are sampled, so 0 means none yet
+  const TimeDiff minRoundTrip = rate.roundTrips.min();
+  return (minRoundTrip > 0
+      and stats.roundTrip > minRoundTrip + settings.maxQueueing)
+      or stats.loss > settings.maxLoss
+      or stats.throttle < settings.minThrottle
+      or stats.reliableInTransit > settings.maxReliableInTransit;
+}
+
+void RateControl::registerPlayer(sky::Player &player) {
+  rates.emplace(std::piecewise_construct,
+                std::forward_as_tuple(player.pid),
+                std::forward_as_tuple(settings.minInterval,
+                                      settings.roundTripWindow));
+  setPlayerData(player, rates.find(player.pid)->second);
+}
+
+void RateControl::unregisterPlayer(sky::Player &player) {
+  rates.erase(rates.find(player.pid));
+}
+
+RateControl::RateControl(sky::Arena &arena,
+                         const RateControlSettings &settings) :
+    sky::Subsystem<PlayerRate>(arena),
+    settings(settings) {
+  arena.forPlayers([&](sky::Player &player) {
+    registerPlayer(player);
+  });
+}
+
+void RateControl::adapt(const sky::Player &player,
+                        const tg::PeerStats &stats) {
+  auto &rate = getPlayerData(player);
+  // ENet reports 0 until it has measured anything; the lowest is over a
+  // window, so a route that got slower for good stops looking congested
+  if (stats.roundTrip > 0) rate.roundTrips.push(stats.roundTrip);
+
+  auto &interval = rate.snapshotTimer.period;
+  if (isCongested(rate, stats)) {
+    interval = std::min(settings.maxInterval, 2 * interval);
+  } else {
+    interval = std::max(settings.minInterval,
+                        interval - settings.recoveryStep);
+  }
+  rate.snapshotTimer.cooldown =
+      std::min(rate.snapshotTimer.cooldown, interval);
+}
+
+bool RateControl::snapshotDue(const sky::Player &player,
+                              const TimeDiff elapsed) {
+  auto &timer = getPlayerData(player).snapshotTimer;
+  // half a tick early rather than a whole tick late
+  if (!timer.cool(elapsed) and timer.cooldown > elapsed / 2) return false;
+  timer.reset();
+  return true;
+}
+
+bool RateControl::isDegraded(const sky::Player &player) const {
+  return getPlayerData(player).snapshotTimer.period > settings.minInterval;
+}
+
+TimeDiff RateControl::getInterval(const sky::Player &player) const {
+  return getPlayerData(player).snapshotTimer.period;
+}
+
+void RateControl::holdKeyframe(const sky::Player &player, const PID pid,
+                               const bool spawn) {
+  getPlayerData(player).heldKeyframes[pid] |= spawn;
+}
+
+void RateControl::holdProps(const sky::Player &player,
+                            const sky::SkyPropSpawns &spawns) {
+  if (!spawns.isEmpty()) getPlayerData(player).heldProps.merge(spawns);
+}
+
+std::map<PID, bool> RateControl::takeHeldKeyframes(
+    const sky::Player &player) {
+  std::map<PID, bool> held;
+  held.swap(getPlayerData(player).heldKeyframes);
+  return held;
+}
+
+sky::SkyPropSpawns RateControl::takeHeldProps(const sky::Player &player) {
+  sky::SkyPropSpawns held;
+  std::swap(held, getPlayerData(player).heldProps);
+  return held;
+}
@@ -0,0 +1,100 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Per-client sky snapshot rate, backing off for congested links.
+ */
+#pragma once
+#include "engine/arena.hpp"
+#include "engine/sky/sky.hpp"
+#include "util/telegraph.hpp"
+#include "util/types.hpp"
+
+/**
+ * Tuning for RateControl.
+ */
+struct RateControlSettings {
+  RateControlSettings(); // sensible defaults
+
+  TimeDiff minInterval, maxInterval; // between snapshots to a client
+  TimeDiff recoveryStep; // interval regained per adaptation without trouble
+
+  // What counts as congestion.
+  TimeDiff maxQueueing; // round trip above the lowest recently
+  unsigned int roundTripWindow; // adaptations that 'recently' spans
+  float maxLoss, minThrottle;
+  size_t maxReliableInTransit;
+
+};
+
+/**
+ * Snapshot schedule for a player.
+ */
+struct PlayerRate {
+  PlayerRate(const TimeDiff interval, const unsigned int roundTripWindow);
+
+  Cooldown snapshotTimer; // its period is the current interval
+  RollingSampler<TimeDiff> roundTrips;
+
+  // Held back until the next snapshot: other participations whose reliable
+  // deltas the player missed (true if one was a spawn), and new props.
+  std::map<PID, bool> heldKeyframes;
+  sky::SkyPropSpawns heldProps;
+
+};
+
+/**
+ * Subsystem scheduling each player's sky snapshots. The interval between
+ * them doubles when their link looks congested and shrinks back step by
+ * step when it doesn't; while it's above the minimum, they also get less
+ * detail.
+ */
+class RateControl: public sky::Subsystem<PlayerRate> {
+ private:
+  std::map<PID, PlayerRate> rates;
+
+  bool isCongested(const PlayerRate &rate,
+                   const tg::PeerStats &stats) const;
+
+ protected:
+  void registerPlayer(sky::Player &player) override final;
+  void unregisterPlayer(sky::Player &player) override final;
+
+ public:
+  RateControl(sky::Arena &arena, const RateControlSettings &settings = {});
+
+  const RateControlSettings settings;
+
+  // Look at a player's link, adjusting their interval.
+  void adapt(const sky::Player &player, const tg::PeerStats &stats);
+
+  // Called once per sky delta, `elapsed` after the last one: whether to
+  // send this one to the player in full, or just what has to go reliably.
+  bool snapshotDue(const sky::Player &player, const TimeDiff elapsed);
+  bool isDegraded(const sky::Player &player) const;
+  TimeDiff getInterval(const sky::Player &player) const;
+
+  // Between snapshots, other planes' keyframes and new props wait for the
+  // next one, and are taken then.
+  void holdKeyframe(const sky::Player &player, const PID pid,
+                    const bool spawn);
+  void holdProps(const sky::Player &player,
+                 const sky::SkyPropSpawns &spawns);
+  std::map<PID, bool> takeHeldKeyframes(const sky::Player &player);
+  sky::SkyPropSpawns takeHeldProps(const sky::Player &player);
+
+};
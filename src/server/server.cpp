@@ -15,6 +15,8 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <cmath>
 #include "server.hpp"
 #include "util/printer.hpp"
 
@@ -37,8 +39,30 @@ sky::Player *ServerShared::playerFromPeer(ENetPeer *peer) const {
   else return nullptr;
 }
 
+void ServerShared::attachPlayer(ENetPeer *peer, sky::Player &player) {
+  peer->data = &player;
+  refreshClients();
+}
+
+void ServerShared::detachPlayer(ENetPeer *peer) {
+  peer->data = nullptr;
+  refreshClients();
+}
+
+void ServerShared::refreshClients() {
+  joinedClients.clear();
+  loadedClients.clear();
+  for (auto const peer : host.getPeers()) {
+    if (sky::Player *player = playerFromPeer(peer)) {
+      joinedClients.push_back(peer);
+      if (!player->isLoadingEnv()) loadedClients.push_back(peer);
+    }
+  }
+}
+
 void ServerShared::registerArenaDelta(const sky::ArenaDelta &arenaDelta) {
   arena.applyDelta(arenaDelta);
+  refreshClients(); // the delta may change who is loading
   sendToClients(sky::ServerPacket::DeltaArena(arenaDelta));
 }
 
@@ -60,16 +84,123 @@ void ServerShared::sendToClients(const sky::ServerPacket &packet) {
       }, packet);
 }
 
+void ServerShared::sendToLoadedClients(const sky::ServerPacket &packet,
+                                       const tg::Channel channel) {
+  telegraph.transmit(
+      host,
+      [&](
+          std::function<void(ENetPeer *const)> transmit) {
+        for (auto const peer : loadedClients) transmit(peer);
+      }, packet, channel);
+}
+
+void ServerShared::sendSkyDelta(const sky::Sky &sky,
+                                const sky::SkyDelta &skyDelta,
+                                const sky::SkyPropSpawns &propSpawns,
+                                const InterestTracker &interest,
+                                RateControl &rates,
+                                const TimeDiff elapsed) {
+  const auto transmitDelta = [&](const std::vector<ENetPeer *> &peers,
+                                 const sky::SkyDelta &delta) {
+    telegraph.transmit(
+        host,
+        [&](
+            std::function<void(ENetPeer *const)> transmit) {
+          for (auto const peer : peers) transmit(peer);
+        },
+        sky::ServerPacket::DeltaSky(delta, arena.getUptime()),
+        delta.needsReliable() ? tg::Channel::Reliable
+                              : tg::Channel::Snapshot);
+  };
+
+  // Clients getting the same participations, or just this tick's props,
+  // share one encoded packet.
+  std::map<std::vector<PID>, std::vector<ENetPeer *>> recipients;
+  std::vector<ENetPeer *> propRecipients;
+  for (auto const peer : loadedClients) {
+    const sky::Player &player = *playerFromPeer(peer);
+    const auto &change = interest.getInterest(player);
+    if (!change.entered.empty() or !change.left.empty()) {
+      sendToClient(peer, sky::ServerPacket::SkyInterest(
+          change.entered, change.left));
+    }
+
+    auto participations = interest.selectParticipations(
+        player, skyDelta, !rates.isDegraded(player));
+    if (!rates.snapshotDue(player, elapsed)) {
+      // Between their snapshots, only their own plane's keyframes; others'
+      // wait for the next one, so a congested link isn't sent them anyway.
+      participations.erase(
+          std::remove_if(
+              participations.begin(), participations.end(),
+              [&](const PID pid) {
+                const auto &delta = skyDelta.participations.at(pid);
+                if (!delta.needsReliable()) return true;
+                if (pid == player.pid) return false;
+                rates.holdKeyframe(player, pid, bool(delta.spawn));
+                return true;
+              }),
+          participations.end());
+      rates.holdProps(player, propSpawns);
+      if (!participations.empty() or skyDelta.settings)
+        recipients[std::move(participations)].push_back(peer);
+      continue;
+    }
+
+    // Their snapshot: what was held back comes as the latest keyframes.
+    const auto heldKeyframes = rates.takeHeldKeyframes(player);
+    if (heldKeyframes.empty()) {
+      recipients[std::move(participations)].push_back(peer);
+    } else {
+      auto resynced = InterestTracker::filter(skyDelta, participations);
+      for (const auto &held : heldKeyframes) {
+        const auto delta = skyDelta.participations.find(held.first);
+        const sky::Player *other = arena.getPlayer(held.first);
+        if (delta == skyDelta.participations.end() or !other) continue;
+        resynced.participations[held.first] =
+            sky.getParticipation(*other).resyncDelta(delta->second,
+                                                     held.second);
+      }
+      transmitDelta({peer}, resynced);
+    }
+
+    auto heldProps = rates.takeHeldProps(player);
+    if (heldProps.isEmpty()) {
+      propRecipients.push_back(peer);
+    } else {
+      heldProps.merge(propSpawns);
+      sky.pruneDeadProps(heldProps);
+      if (!heldProps.isEmpty())
+        sendToClient(peer, sky::ServerPacket::SpawnProps(
+            heldProps, arena.getUptime()));
+    }
+  }
+
+  for (const auto &group : recipients) {
+    transmitDelta(group.second,
+                  InterestTracker::filter(skyDelta, group.first));
+  }
+
+  // New props are events, not state a later snapshot brings back.
+  if (!propSpawns.isEmpty() and !propRecipients.empty()) {
+    telegraph.transmit(
+        host,
+        [&](
+            std::function<void(ENetPeer *const)> transmit) {
+          for (auto const peer : propRecipients) transmit(peer);
+        },
+        sky::ServerPacket::SpawnProps(propSpawns, arena.getUptime()));
+  }
+}
+
 void ServerShared::sendToClientsExcept(const PID pid,
                                        const sky::ServerPacket &packet) {
   telegraph.transmit(
       host,
       [&](
           std::function<void(ENetPeer *const)> transmit) {
-        for (auto const peer : host.getPeers()) {
-          if (sky::Player *player = playerFromPeer(peer)) {
-            if (player->pid != pid) transmit(peer);
-          }
+        for (auto const peer : joinedClients) {
+          if (playerFromPeer(peer)->pid != pid) transmit(peer);
         }
       }, packet);
 }
@@ -108,6 +239,47 @@ void ServerLogger::onEvent(const sky::ArenaEvent &event) {
 ServerLogger::ServerLogger(ServerShared &shared, sky::Arena &arena) :
     sky::ArenaLogger(arena), shared(shared) { }
 
+/**
+ * ServerLoopSettings.
+ */
+
+ServerLoopSettings::ServerLoopSettings() :
+    tickPeriod(1.0f / 60.0f),
+    maxCatchUpTicks(5),
+    maxClients(32) { }
+
+/**
+ * ServerLoopStats.
+ */
+
+ServerLoopStats::ServerLoopStats() :
+    ticks(0),
+    overruns(0),
+    droppedTicks(0),
+    tickTimes(60),
+    tickHistogram(1000, 0) { }
+
+void ServerLoopStats::recordTick(const TimeDiff tickTime,
+                                 const TimeDiff period) {
+  ticks++;
+  tickTimes.push(tickTime);
+  if (tickTime > period) overruns++;
+
+  const auto bucket = size_t(std::max(0.0f, tickTime) / histogramStep);
+  tickHistogram[std::min(bucket, tickHistogram.size() - 1)]++;
+}
+
+TimeDiff ServerLoopStats::tickTimePercentile(const float fraction) const {
+  if (ticks == 0) return 0;
+  const auto target = (unsigned long) std::ceil(fraction * ticks);
+  unsigned long seen = 0;
+  for (size_t bucket = 0; bucket < tickHistogram.size(); bucket++) {
+    seen += tickHistogram[bucket];
+    if (seen >= target and seen > 0) return (bucket + 1) * histogramStep;
+  }
+  return tickHistogram.size() * histogramStep;
+}
+
 /**
  * ServerExec.
  */
@@ -184,10 +356,21 @@ void ServerExec::processPacket(ENetPeer *client,
     // client hasn't joined the arena yet
 
     if (packet.type == ClientPacket::Type::ReqJoin) {
+      if (packet.arenaName
+          and packet.arenaName.get() != shared.arena.getName()) {
+        const auto sibling = directory.find(packet.arenaName.get());
+        if (sibling != directory.end()) {
+          shared.sendToClient(client, ServerPacket::Redirect(
+              sibling->first, sibling->second));
+          return;
+        }
+        // otherwise, welcome to this arena
+      }
+
       const ArenaDelta delta =
           shared.arena.connectPlayer(packet.stringData.get());
       Player *newPlayer = shared.arena.getPlayer(delta.join->pid);
-      client->data = newPlayer;
+      shared.attachPlayer(client, *newPlayer);
 
       shared.logEvent(ServerEvent::Connect(newPlayer->getNickname()));
       shared.sendToClient(client, ServerPacket::Init(
@@ -201,10 +384,9 @@ void ServerExec::processPacket(ENetPeer *client,
   }
 }
 
-bool ServerExec::poll() {
+bool ServerExec::poll(const TimeDiff timeout) {
   // Network.
-  static ENetEvent event;
-  event = host.poll();
+  const ENetEvent event = host.poll(timeout);
 
   switch (event.type) {
     case ENET_EVENT_TYPE_NONE:
@@ -216,9 +398,11 @@ bool ServerExec::poll() {
     }
     case ENET_EVENT_TYPE_DISCONNECT: {
       if (sky::Player *player = shared.playerFromPeer(event.peer)) {
+        const PID pid = player->pid;
         shared.logEvent(ServerEvent::Disconnect(player->getNickname()));
-        shared.registerArenaDelta(sky::ArenaDelta::Quit(player->pid));
-        event.peer->data = nullptr;
+        // detach first, the player doesn't survive the quit
+        shared.detachPlayer(event.peer);
+        shared.registerArenaDelta(sky::ArenaDelta::Quit(pid));
       }
       return false;
     }
@@ -246,6 +430,11 @@ void ServerExec::tick(const TimeDiff delta) {
     }
   }
 
+  // Sky packets, both ways, are packed against its map; clients take its
+  // dimensions from the InitSky.
+  if (const auto sky = shared.skyHandle.getSky())
+    telegraph.setPackingBounds(sky->getMap().getDimensions());
+
   // Tick game state and network host.
   shared.arena.tick(delta);
   host.tick(delta);
@@ -258,17 +447,13 @@ void ServerExec::tick(const TimeDiff delta) {
   // Sky update and initialization scheduling.
   if (const auto sky = shared.skyHandle.getSky()) {
     if (skyDeltaTimer.cool(delta)) {
-      auto skyDelta = sky->collectDelta();
-
-      for (auto peer : host.getPeers()) {
-        if (sky::Player *player = shared.playerFromPeer(peer)) {
-          if (!player->isLoadingEnv())
-            shared.sendToClient(
-                peer, sky::ServerPacket::DeltaSky(
-                skyDelta.respectAuthority(*player),
-                shared.arena.getUptime()));
-        }
-      }
+      // Encoded once per set of participations sent; clients respect their
+      // own authority when they apply it.
+      const auto skyDelta = sky->collectDelta();
+      const auto propSpawns = sky->collectPropSpawns();
+      interestTracker.update(*sky);
+      shared.sendSkyDelta(*sky, skyDelta, propSpawns, interestTracker,
+                          rateControl, skyDeltaTimer.period);
       skyDeltaTimer.reset();
     }
   }
@@ -294,26 +479,43 @@ void ServerExec::tick(const TimeDiff delta) {
     shared.registerArenaDelta(latencyTracker.makeUpdate());
     latencyUpdateTimer.reset();
   }
+
+  // Snapshot rate adaptation.
+  if (rateUpdateTimer.cool(delta)) {
+    for (auto const peer : host.getPeers()) {
+      if (const sky::Player *player = shared.playerFromPeer(peer))
+        rateControl.adapt(*player, tg::PeerStats(*peer));
+    }
+    rateUpdateTimer.reset();
+  }
 }
 
 ServerExec::ServerExec(
     const Port port,
     const sky::ArenaInit &arenaInit,
     std::function<std::unique_ptr<ServerListener>(
-        ServerShared &)> mkServer) :
+        ServerShared &)> mkServer,
+    const ServerLoopSettings &loopSettings,
+    const ArenaDirectory &directory) :
 
-    host(tg::HostType::Server, port),
+    host(tg::HostType::Server, port, loopSettings.maxClients),
     shared(host, telegraph, arenaInit),
 
     skyDeltaTimer(0.03),
     scoreDeltaTimer(0.5),
     pingTimer(1),
     latencyUpdateTimer(2),
+    rateUpdateTimer(0.5),
 
     server(mkServer(shared)),
 
     logger(shared, shared.arena),
     latencyTracker(shared.arena),
+    interestTracker(shared.arena),
+    rateControl(shared.arena),
+
+    loopSettings(loopSettings),
+    directory(directory),
 
     running(true) {
 
@@ -325,11 +527,42 @@ ServerExec::ServerExec(
 }
 
 void ServerExec::run() {
-  sf::Clock clock;
+  const TimeDiff period = loopSettings.tickPeriod;
+  sf::Clock clock, tickClock;
+  TimeDiff behind = 0; // simulation time we owe
+
   while (running) {
-    tick(clock.restart().asSeconds());
-    while (!poll()) { }
+    behind += clock.restart().asSeconds();
+
+    // Run the simulation at a fixed rate, catching up on missed ticks
+    // up to a limit; past that, the backlog is dropped.
+    unsigned int caughtUp = 0;
+    while (behind >= period) {
+      if (caughtUp == loopSettings.maxCatchUpTicks) {
+        const auto dropped = (unsigned long) (behind / period);
+        loopStats.droppedTicks += dropped;
+        behind -= dropped * period;
+        break;
+      }
+
+      tickClock.restart();
+      tick(period);
+      loopStats.recordTick(tickClock.getElapsedTime().asSeconds(), period);
+
+      behind -= period;
+      caughtUp++;
+    }
 
-    sf::sleep(sf::milliseconds(16));
+    // Sleep on the socket until a packet arrives or the next tick is due,
+    // then drain the queue.
+    const TimeDiff untilTick =
+        period - behind - clock.getElapsedTime().asSeconds();
+    if (!poll(untilTick)) {
+      while (!poll()) { }
+    }
   }
 }
+
+const ServerLoopStats &ServerExec::getLoopStats() const {
+  return loopStats;
+}
@@ -20,9 +20,12 @@
  */
 #pragma once
 #include <iostream>
+#include <atomic>
 #include "engine/arena.hpp"
 #include "util/telegraph.hpp"
 #include "latencytracker.hpp"
+#include "interest.hpp"
+#include "ratecontrol.hpp"
 #include "engine/protocol.hpp"
 #include "engine/event.hpp"
 
@@ -31,6 +34,11 @@
  * / logging methods.
  */
 struct ServerShared {
+ private:
+  // Peers with a player in the arena, and the subset that loaded the
+  // environment; kept up to date so broadcasts only visit recipients.
+  std::vector<ENetPeer *> joinedClients, loadedClients;
+
  public:
   ServerShared(tg::Host &host, tg::Telegraph<sky::ClientPacket> &telegraph,
                const sky::ArenaInit &arenaInit);
@@ -44,6 +52,9 @@ struct ServerShared {
   tg::Host &host;
   tg::Telegraph<sky::ClientPacket> &telegraph;
   sky::Player *playerFromPeer(ENetPeer *peer) const;
+  void attachPlayer(ENetPeer *peer, sky::Player &player);
+  void detachPlayer(ENetPeer *peer);
+  void refreshClients();
 
   // Centralized state modification / synchronization.
   void registerArenaDelta(const sky::ArenaDelta &arenaDelta);
@@ -52,7 +63,16 @@ struct ServerShared {
 
   // Transmission.
   void sendToClients(const sky::ServerPacket &packet);
-  void sendToLoadedClients(const sky::ServerPacket &packet);
+  void sendToLoadedClients(const sky::ServerPacket &packet,
+                           const tg::Channel channel = tg::Channel::Reliable);
+  // Each loaded client gets the participations it's interested in, and
+  // new props, as often as its link allows.
+  void sendSkyDelta(const sky::Sky &sky,
+                    const sky::SkyDelta &skyDelta,
+                    const sky::SkyPropSpawns &propSpawns,
+                    const InterestTracker &interest,
+                    RateControl &rates,
+                    const TimeDiff elapsed);
   void sendToClientsExcept(const PID pid,
                            const sky::ServerPacket &packet);
   void sendToClient(ENetPeer *const client,
@@ -113,6 +133,45 @@ class ServerLogger: public sky::ArenaLogger {
 
 };
 
+/**
+ * Scheduling and capacity parameters for ServerExec.
+ */
+struct ServerLoopSettings {
+  ServerLoopSettings(); // sensible defaults
+
+  TimeDiff tickPeriod; // fixed length of a simulation tick
+  unsigned int maxCatchUpTicks; // max ticks to run back-to-back when behind
+  size_t maxClients; // peer capacity of the host
+
+};
+
+/**
+ * Counters describing how well the ServerExec loop keeps its tick rate.
+ */
+struct ServerLoopStats {
+  ServerLoopStats();
+
+  unsigned long ticks, // ticks simulated
+      overruns, // ticks that took longer than the tick period
+      droppedTicks; // ticks skipped because we hit the catch-up cap
+  RollingSampler<TimeDiff> tickTimes; // recent time spent in tick()
+  // Time spent in tick() over the whole run, in histogramStep buckets; the
+  // last bucket holds everything longer.
+  std::vector<unsigned long> tickHistogram;
+
+  static constexpr TimeDiff histogramStep = 0.00005;
+
+  void recordTick(const TimeDiff tickTime, const TimeDiff period);
+  // Tick time below which `fraction` of the ticks fall.
+  TimeDiff tickTimePercentile(const float fraction) const;
+
+};
+
+/**
+ * Arenas hosted by the same server process, by name, with their ports.
+ */
+using ArenaDirectory = std::map<std::string, Port>;
+
 /**
  * State and logic associated with the execution of a Server.
  * We manage the basics here.
@@ -132,7 +191,8 @@ class ServerExec {
   Cooldown skyDeltaTimer,
       scoreDeltaTimer,
       pingTimer,
-      latencyUpdateTimer;
+      latencyUpdateTimer,
+      rateUpdateTimer;
 
   // Attached server.
   std::unique_ptr<ServerListener> server;
@@ -140,20 +200,32 @@ class ServerExec {
   // Subsystems.
   ServerLogger logger;
   LatencyTracker latencyTracker;
+  InterestTracker interestTracker;
+  RateControl rateControl;
+
+  // Loop scheduling.
+  const ServerLoopSettings loopSettings;
+  ServerLoopStats loopStats;
+
+  // Sibling arenas, for routing ReqJoins.
+  const ArenaDirectory directory;
 
   // Server loop subroutines.
   void processPacket(ENetPeer *client, const sky::ClientPacket &packet);
   // (returns true when the queue has been exhausted)
-  bool poll();
+  bool poll(const TimeDiff timeout = 0);
   void tick(const TimeDiff delta);
 
  public:
   ServerExec(const Port port,
              const sky::ArenaInit &arenaInit,
              std::function<std::unique_ptr<ServerListener>(
-                 ServerShared &)> mkServer);
+                 ServerShared &)> mkServer,
+             const ServerLoopSettings &loopSettings = {},
+             const ArenaDirectory &directory = {});
 
   void run();
+  const ServerLoopStats &getLoopStats() const;
 
-  bool running;
+  std::atomic<bool> running; // may be cleared from another thread
 };
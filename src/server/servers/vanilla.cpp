@@ -16,8 +16,48 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "vanilla.hpp"
+#include "util/methods.hpp"
+
+namespace {
+
+// Lag compensation doesn't go back further than this; PlaneHistory keeps
+// a little over a second.
+const TimeDiff maxRewind = 1.0;
+
+}
+
+void VanillaServer::compensateHits(sky::Sky &sky) {
+  // A shooter aimed at where their screen showed the others: their action
+  // took half a round trip to get here, and they show other planes behind
+  // the server's clock. Test their props against that instead.
+  arena.forPlayers([&](sky::Player &shooter) {
+    const auto &shooting = sky.getParticipation(shooter);
+    if (shooting.props.empty()) return;
+    const TimeDiff rewind =
+        shooter.getLatency() / 2 + shooting.getViewDelay();
+    const Time viewTime = arena.getUptime() - std::min(rewind, maxRewind);
+
+    arena.forPlayers([&](sky::Player &target) {
+      auto &participation = sky.getParticipation(target);
+      if (target.pid == shooter.pid or !participation.isSpawned()) return;
+      sky::Plane &plane = participation.plane.get();
+      if (plane.getState().health == 0) return;
+
+      for (const auto &prop : shooting.props) {
+        if (participation.getHistory().contains(
+            viewTime, plane.getTuning().hitbox,
+            prop.second.getPhysical().pos)) {
+          plane.damage(plane.getState().health);
+          return;
+        }
+      }
+    });
+  });
+}
 
 void VanillaServer::tickGame(const TimeDiff delta, sky::Sky &sky) {
+  compensateHits(sky);
+
   arena.forPlayers([&](sky::Player &player) {
     auto &participation = sky.getParticipation(player);
     if (participation.isSpawned()) {
@@ -69,7 +109,8 @@ void VanillaServer::onEndContact(const sky::BodyTag &body1, const sky::BodyTag &
 }
 
 bool VanillaServer::enableContact(const sky::BodyTag &body1, const sky::BodyTag &body2) {
-  //Doesn't work for planes because physics is client authoritative
+  //Doesn't work for planes because physics is client authoritative;
+  //this also leaves prop hits to compensateHits, in the shooter's view
   return false;
 }
 
@@ -178,8 +219,7 @@ void VanillaServer::onPacket(ENetPeer *const client,
       }
 
       //Spawn them
-      auto sp = shared.skyHandle.getSky()
-        ->getMap().pickSpawnPoint(player.getTeam());
+      auto sp = shared.skyHandle.getSky()->pickSpawnPoint(player);
       player.spawn({}, sp.pos, sp.angle);
     }
   }
@@ -26,6 +26,7 @@ class VanillaServer: public Server<Nothing> {
  private:
   // Subroutines.
   void tickGame(const TimeDiff delta, sky::Sky &sky);
+  void compensateHits(sky::Sky &sky);
 
  protected:
   // Subsystem callbacks.
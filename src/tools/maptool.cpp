@@ -0,0 +1,95 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Map tool: offline processing of environment map files.
+ *
+ * solemnsky_maptool cache <map.json> [output.json]
+ *   Writes the map with its decomposition cache filled in (in place if no
+ *   output is given), so loading it skips partitioning obstacles.
+ *
+ * solemnsky_maptool binary <map.json> <map.bin>
+ *   Converts the map to the binary format, which environments prefer to
+ *   the JSON one when they have both.
+ */
+#include <fstream>
+#include <iostream>
+#include "engine/environment/map.hpp"
+#include "util/printer.hpp"
+
+namespace {
+
+int usage() {
+  std::cerr << "usage: solemnsky_maptool cache <map.json> [output.json]\n"
+            << "       solemnsky_maptool binary <map.json> <map.bin>\n";
+  return 1;
+}
+
+int cacheDecomposition(const std::string &input, const std::string &output) {
+  std::ifstream inputFile(input);
+  if (!inputFile) {
+    appLog("Could not open " + inQuotes(input) + "!", LogOrigin::Error);
+    return 1;
+  }
+  auto map = sky::Map::load(inputFile);
+  inputFile.close(); // we may be writing in place
+  if (!map) return 1;
+
+  std::ofstream file(output);
+  if (!file) {
+    appLog("Could not write " + inQuotes(output) + "!", LogOrigin::Error);
+    return 1;
+  }
+  map->save(file);
+  appLog("Wrote " + inQuotes(output) + " with "
+             + std::to_string(map->getObstacles().size())
+             + " obstacle decomposition(s).", LogOrigin::App);
+  return 0;
+}
+
+int convertToBinary(const std::string &input, const std::string &output) {
+  std::ifstream inputFile(input);
+  if (!inputFile) {
+    appLog("Could not open " + inQuotes(input) + "!", LogOrigin::Error);
+    return 1;
+  }
+  const auto map = sky::Map::load(inputFile);
+  if (!map) return 1;
+
+  std::ofstream file(output, std::ios::binary);
+  map->saveBinary(file);
+  if (!file) {
+    appLog("Could not write " + inQuotes(output) + "!", LogOrigin::Error);
+    return 1;
+  }
+  appLog("Wrote binary map " + inQuotes(output) + ".", LogOrigin::App);
+  return 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) return usage();
+  const std::string command = argv[1];
+
+  if (command == "cache")
+    return cacheDecomposition(argv[2], (argc > 3) ? argv[3] : argv[2]);
+  if (command == "binary" and argc > 3)
+    return convertToBinary(argv[2], argv[3]);
+
+  return usage();
+}
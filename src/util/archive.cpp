@@ -16,7 +16,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "archive.hpp"
-#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <zlib.h>
 #include "util/printer.hpp"
 #include "methods.hpp"
 
@@ -67,17 +70,116 @@ optional<Directory> Directory::open(const fs::path &path) {
   }
 }
 
+/**
+ * Zip format helpers.
+ */
+
+namespace {
+
+const uint32_t endOfDirectorySignature = 0x06054b50,
+    directoryEntrySignature = 0x02014b50,
+    localHeaderSignature = 0x04034b50;
+
+const size_t endOfDirectorySize = 22,
+    directoryEntrySize = 46,
+    localHeaderSize = 30;
+
+// Deflate expands by at most 1032:1, so a larger claim is a lie; and no file
+// in an environment comes near the cap. Either way we won't allocate it.
+const size_t maxDeflateRatio = 1032,
+    maxEntrySize = size_t(1) << 28;
+
+// Little-endian reads, bounds-checked by the callers.
+uint16_t read16(const unsigned char *p) {
+  return uint16_t(p[0] | (p[1] << 8));
+}
+
+uint32_t read32(const unsigned char *p) {
+  return uint32_t(p[0]) | (uint32_t(p[1]) << 8)
+      | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+bool inflateRaw(const unsigned char *input, const size_t inputSize,
+                std::string &output) {
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) return false;
+
+  stream.next_in = const_cast<unsigned char *>(input);
+  stream.avail_in = uInt(inputSize);
+  stream.next_out = (Bytef *) &output[0];
+  stream.avail_out = uInt(output.size());
+  const int result = inflate(&stream, Z_FINISH);
+  inflateEnd(&stream);
+
+  return result == Z_STREAM_END and stream.total_out == output.size();
+}
+
+}
+
 /**
  * Archive.
  */
 
+bool Archive::readCentralDirectory() {
+  if (data.size() < endOfDirectorySize) return false;
+
+  // The end record sits behind a comment of up to 64k.
+  const unsigned char *end = nullptr;
+  const size_t searchLimit =
+      std::min(data.size(), endOfDirectorySize + size_t(0xffff));
+  for (size_t back = endOfDirectorySize; back <= searchLimit; back++) {
+    const unsigned char *candidate = data.data() + data.size() - back;
+    if (read32(candidate) == endOfDirectorySignature) {
+      end = candidate;
+      break;
+    }
+  }
+  if (!end) return false;
+
+  const size_t entryCount = read16(end + 10);
+  size_t offset = read32(end + 16);
+
+  for (size_t i = 0; i < entryCount; i++) {
+    if (offset + directoryEntrySize > data.size()) return false;
+    const unsigned char *record = data.data() + offset;
+    if (read32(record) != directoryEntrySignature) return false;
+
+    const size_t nameLength = read16(record + 28),
+        extraLength = read16(record + 30),
+        commentLength = read16(record + 32);
+    if (offset + directoryEntrySize + nameLength > data.size()) return false;
+
+    ArchiveEntry entry;
+    entry.path.assign((const char *) record + directoryEntrySize, nameLength);
+    entry.method = read16(record + 10);
+    entry.crc = read32(record + 16);
+    entry.compressedSize = read32(record + 20);
+    entry.size = read32(record + 24);
+    entry.headerOffset = read32(record + 42);
+
+    const bool encrypted = bool(read16(record + 8) & 1);
+    if (encrypted or entry.compressedSize == 0xffffffff) {
+      appLog("Skipping encrypted or zip64 file in archive: "
+                 + inQuotes(entry.path), LogOrigin::Error);
+    } else if (entry.path.empty() or entry.path.back() != '/') {
+      entries.push_back(std::move(entry));
+    }
+
+    offset += directoryEntrySize + nameLength + extraLength + commentLength;
+  }
+
+  return true;
+}
+
 Archive::Archive(const fs::path &archivePath) :
     done(false),
+    opened(false),
     archivePath(archivePath) {}
 
-void Archive::load() {
+void Archive::load(const ProgressMonitor &monitor) {
   const auto filepath = this->archivePath.string();
-  appLog("Unzipping archive: " + filepath, LogOrigin::App);
+  appLog("Opening archive: " + filepath, LogOrigin::App);
 
   if (!fs::exists(this->archivePath)) {
     appLog("Archive filepath does not exist!", LogOrigin::Error);
@@ -91,25 +193,142 @@ void Archive::load() {
     return;
   }
 
-  fs::path workingDir(".unzip-tmp/" + std::to_string(getProcessID()) + "/"
-                          + this->archivePath.filename().string());
-  fs::remove_all(workingDir);
-  fs::create_directories(workingDir);
+  std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+  const auto fileSize = file.tellg();
+  if (!file or fileSize < 0) {
+    appLog("Could not read archive file!", LogOrigin::Error);
+    this->done = true;
+    return;
+  }
+  data.resize(size_t(fileSize));
+  file.seekg(0);
 
-  // Invoke 7zip through the shell. I'm sorry.
-  chdir(workingDir.string().c_str());
-  runSystemQuiet("7z x " + inQuotes(archivePath.string()));
-  chdir("../../../");
+  // In chunks, so the monitor can follow along.
+  const size_t chunkSize = 1 << 20;
+  size_t read = 0;
+  while (read < data.size()) {
+    const size_t chunk = std::min(chunkSize, data.size() - read);
+    if (!file.read((char *) data.data() + read, chunk)) break;
+    read += chunk;
+    if (monitor and !monitor(float(read) / float(data.size()))) {
+      appLog("Stopped reading archive.", LogOrigin::App);
+      data.clear();
+      this->done = true;
+      return;
+    }
+  }
+  if (read < data.size()) {
+    appLog("Could not read archive file!", LogOrigin::Error);
+    data.clear();
+    this->done = true;
+    return;
+  }
 
-  if (const auto opened = Directory::open(workingDir))
-    this->result.emplace(*opened);
+  if (readCentralDirectory()) {
+    opened = true;
+  } else {
+    appLog("Archive is not a zip file we can read!", LogOrigin::Error);
+    data.clear();
+    entries.clear();
+  }
+  this->done = true;
 }
 
 bool Archive::isDone() const {
   return done;
 }
 
-Directory const *Archive::getResult() const {
-  return result.get_ptr();
+bool Archive::isOpen() const {
+  return opened;
+}
+
+const std::vector<ArchiveEntry> &Archive::getEntries() const {
+  return entries;
+}
+
+ArchiveEntry const *Archive::getEntry(const std::string &path) const {
+  const auto entry = std::find_if(
+      entries.begin(), entries.end(),
+      [&](const ArchiveEntry &entry) { return entry.path == path; });
+  return (entry == entries.end()) ? nullptr : &*entry;
+}
+
+const unsigned char *Archive::locateContents(
+    const ArchiveEntry &entry) const {
+  // The local header's variable fields can differ from the directory's.
+  const size_t header = entry.headerOffset;
+  if (header + localHeaderSize > data.size()
+      or read32(data.data() + header) != localHeaderSignature) {
+    appLog("Corrupt header in archive for " + inQuotes(entry.path),
+           LogOrigin::Error);
+    return nullptr;
+  }
+  const size_t start = header + localHeaderSize
+      + read16(data.data() + header + 26) + read16(data.data() + header + 28);
+  if (start + entry.compressedSize > data.size()) {
+    appLog("Truncated archive data for " + inQuotes(entry.path),
+           LogOrigin::Error);
+    return nullptr;
+  }
+  return data.data() + start;
+}
+
+optional<std::string> Archive::readFile(const std::string &path) const {
+  const ArchiveEntry *entry = getEntry(path);
+  if (!entry) return {};
+  const unsigned char *contents = locateContents(*entry);
+  if (!contents) return {};
+
+  if (entry->size > maxEntrySize
+      or entry->size > size_t(entry->compressedSize) * maxDeflateRatio) {
+    appLog("Implausible file size in archive for " + inQuotes(path),
+           LogOrigin::Error);
+    return {};
+  }
+
+  std::string result(entry->size, '\0');
+  bool success = false;
+  switch (entry->method) {
+    case 0: {
+      success = entry->compressedSize == entry->size;
+      if (success) std::memcpy(&result[0], contents, entry->size);
+      break;
+    }
+    case 8: {
+      success = entry->size == 0
+          or inflateRaw(contents, entry->compressedSize, result);
+      break;
+    }
+    default: {
+      appLog("Unsupported compression method in archive for "
+                 + inQuotes(path), LogOrigin::Error);
+      return {};
+    }
+  }
+
+  if (!success or crc32(0, (const Bytef *) result.data(), uInt(result.size()))
+      != entry->crc) {
+    appLog("Corrupt archive data for " + inQuotes(path), LogOrigin::Error);
+    return {};
+  }
+  return result;
+}
+
+optional<std::string> Archive::readTopFile(const std::string &filename) const {
+  if (filename.find('/') != std::string::npos) return {};
+  return readFile(filename);
 }
 
+optional<ArchiveView> Archive::viewFile(const std::string &path) const {
+  const ArchiveEntry *entry = getEntry(path);
+  if (!entry or entry->method != 0 or entry->compressedSize != entry->size)
+    return {};
+  const unsigned char *contents = locateContents(*entry);
+  if (!contents) return {};
+
+  if (crc32(0, contents, uInt(entry->size)) != entry->crc) {
+    appLog("Corrupt archive data for " + inQuotes(path), LogOrigin::Error);
+    return {};
+  }
+  return ArchiveView{contents, entry->size};
+}
@@ -19,12 +19,13 @@
  * Utilities to open and access zip archives.
  */
 #pragma once
+#include <cstdint>
 #include "util/types.hpp"
 #include "util/threads.hpp"
 #include "util/filepath.hpp"
 
 /**
- * Handle to the directory of an opened archive, whose contents we can access.
+ * Handle to a directory on disk, whose contents we can access.
  */
 struct Directory {
  private:
@@ -50,27 +51,62 @@ struct Directory {
 };
 
 /**
- * Handle to the (asynchronous) process of opening an archive.
- * Uses the 7z binary found in the system PATH to unzip.
+ * A file in an Archive.
+ */
+struct ArchiveEntry {
+  std::string path; // in the archive, with '/' separators
+  uint16_t method; // 0 = stored, 8 = deflated
+  uint32_t crc;
+  uint32_t compressedSize, size;
+  size_t headerOffset; // of the local file header
+};
+
+/**
+ * Bytes of a file inside an Archive, valid as long as the Archive is.
+ */
+struct ArchiveView {
+  const unsigned char *data;
+  size_t size;
+};
+
+/**
+ * A zip archive, read in-process: the file is read into memory once, and
+ * files are inflated from it on request. Reading files is const and
+ * touches no shared state, so it's safe from several threads at once.
  */
 class Archive {
  private:
-
   // Result state.
   bool done;
-  optional<Directory> result;
+  bool opened;
+  std::vector<unsigned char> data;
+  std::vector<ArchiveEntry> entries;
+
+  bool readCentralDirectory();
+  // Where an entry's (maybe compressed) contents start, or nullptr.
+  const unsigned char *locateContents(const ArchiveEntry &entry) const;
 
  public:
   Archive(const fs::path &archivePath);
 
   const fs::path archivePath;
 
-  // Try to load the archive -- this is blocking.
-  void load();
+  // Try to load the archive -- this is blocking. The monitor follows the
+  // file being read, and can stop it.
+  void load(const ProgressMonitor &monitor = {});
   bool isDone() const;
+  bool isOpen() const;
 
-  // When done, we present either a result or an error.
-  Directory const *getResult() const;
+  // When open, the files in the archive (directories aren't listed).
+  const std::vector<ArchiveEntry> &getEntries() const;
+  ArchiveEntry const *getEntry(const std::string &path) const;
 
-};
+  // Contents of a file, by its path in the archive, or by name when it's at
+  // the top level.
+  optional<std::string> readFile(const std::string &path) const;
+  optional<std::string> readTopFile(const std::string &filename) const;
+  // A file's contents without copying them out, if it's stored
+  // uncompressed.
+  optional<ArchiveView> viewFile(const std::string &path) const;
 
+};
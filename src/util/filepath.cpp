@@ -31,6 +31,10 @@ fs::path getEnvironmentPath(const std::string &path) {
   return getTopPath("environments/export/" + path);
 }
 
+fs::path getCachePath(const std::string &path) {
+  return getTopPath("cache/" + path);
+}
+
 fs::path getTestPath(const std::string &path) {
   return getTopPath("tests/" + path);
 }
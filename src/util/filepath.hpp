@@ -36,6 +36,12 @@ fs::path getMediaPath(const std::string &path);
  */
 fs::path getEnvironmentPath(const std::string &path);
 
+/**
+ * Access a path relative to the cache directory, for files we can always
+ * regenerate.
+ */
+fs::path getCachePath(const std::string &path);
+
 /**
  * Access a path relative to the test file directory.
  */
@@ -0,0 +1,297 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <cstring>
+#include "packing.hpp"
+
+namespace tg {
+
+namespace {
+
+/**
+ * Quantization parameters: a range and a bit width.
+ */
+struct QuantumRange {
+  float min, max;
+  unsigned int bits;
+};
+
+// Returns false when the value has to be sent raw (no bounds to go by).
+bool getRange(const Quantum quantum, const bool yAxis,
+              const bool hasBounds, const sf::Vector2f &bounds,
+              QuantumRange &range) {
+  const float extent = yAxis ? bounds.y : bounds.x;
+  switch (quantum) {
+    case Quantum::Unit: {
+      range = {0, 1, 12};
+      return true;
+    }
+    case Quantum::Angle: {
+      range = {0, 360, 16};
+      return true;
+    }
+    case Quantum::AngularVelocity: {
+      range = {-1440, 1440, 16};
+      return true;
+    }
+    case Quantum::Position: {
+      if (!hasBounds) return false;
+      // things can leave the map a bit, give them some slack
+      range = {-extent / 2, extent * 1.5f, 20};
+      return true;
+    }
+    case Quantum::Velocity: {
+      if (!hasBounds) return false;
+      // crossing the map twice in a second is plenty
+      const float limit = 2 * std::max(bounds.x, bounds.y);
+      range = {-limit, limit, 18};
+      return true;
+    }
+  }
+  return false;
+}
+
+bool validBounds(const sf::Vector2f &dims) {
+  return std::isfinite(dims.x) && std::isfinite(dims.y)
+      && dims.x > 0 && dims.y > 0;
+}
+
+std::uint32_t maxQuantized(const unsigned int bits) {
+  return (std::uint32_t(1) << bits) - 1;
+}
+
+}
+
+/**
+ * PackedOutputArchive.
+ */
+
+PackedOutputArchive::PackedOutputArchive(std::ostream &stream) :
+    cereal::OutputArchive<PackedOutputArchive,
+                          cereal::AllowEmptyClassElision>(this),
+    stream(stream),
+    pending(0),
+    pendingCount(0),
+    hasBounds(false) { }
+
+PackedOutputArchive::~PackedOutputArchive() {
+  try {
+    flush();
+  } catch (...) { }
+}
+
+void PackedOutputArchive::writeBits(const std::uint32_t value,
+                                    const unsigned int count) {
+  const std::uint64_t mask = (std::uint64_t(1) << count) - 1;
+  pending |= (std::uint64_t(value) & mask) << pendingCount;
+  pendingCount += count;
+
+  while (pendingCount >= 8) {
+    if (stream.rdbuf()->sputc(char(pending & 0xff))
+        == std::char_traits<char>::eof())
+      throw cereal::Exception("Failed to write to output stream!");
+    pending >>= 8;
+    pendingCount -= 8;
+  }
+}
+
+void PackedOutputArchive::writeVarint(std::uint64_t value) {
+  do {
+    const std::uint32_t group = std::uint32_t(value & 0x7f);
+    value >>= 7;
+    writeBits(group | (value ? 0x80 : 0), 8);
+  } while (value);
+}
+
+void PackedOutputArchive::saveBinary(const void *data,
+                                     const std::size_t size) {
+  const auto bytes = (const unsigned char *) data;
+  for (std::size_t i = 0; i < size; ++i) writeBits(bytes[i], 8);
+}
+
+void PackedOutputArchive::flush() {
+  if (pendingCount > 0) writeBits(0, 8 - pendingCount);
+}
+
+void PackedOutputArchive::setBounds(const sf::Vector2f &dimensions) {
+  hasBounds = validBounds(dimensions);
+  bounds = dimensions;
+}
+
+void PackedOutputArchive::writeQuantized(const float x,
+                                         const Quantum quantum,
+                                         const bool yAxis) {
+  QuantumRange range;
+  if (!getRange(quantum, yAxis, hasBounds, bounds, range)) {
+    detail::saveArithmetic(*this, x);
+    return;
+  }
+
+  const std::uint32_t steps = maxQuantized(range.bits);
+  float normalized = std::isfinite(x)
+      ? (x - range.min) / (range.max - range.min) : 0;
+
+  if (quantum == Quantum::Angle) {
+    // cyclic: 360 wraps to 0
+    writeBits(std::uint32_t(std::lround(normalized * (steps + 1))) & steps,
+              range.bits);
+  } else {
+    normalized = std::min(1.0f, std::max(0.0f, normalized));
+    writeBits(std::uint32_t(std::lround(normalized * steps)), range.bits);
+  }
+}
+
+/**
+ * PackedInputArchive.
+ */
+
+PackedInputArchive::PackedInputArchive(std::istream &stream) :
+    cereal::InputArchive<PackedInputArchive,
+                         cereal::AllowEmptyClassElision>(this),
+    stream(stream),
+    pending(0),
+    pendingCount(0),
+    hasBounds(false) { }
+
+std::uint32_t PackedInputArchive::readBits(const unsigned int count) {
+  while (pendingCount < count) {
+    const auto c = stream.rdbuf()->sbumpc();
+    if (c == std::char_traits<char>::eof())
+      throw cereal::Exception("Failed to read from input stream!");
+    pending |= std::uint64_t((unsigned char) c) << pendingCount;
+    pendingCount += 8;
+  }
+
+  const std::uint64_t mask = (std::uint64_t(1) << count) - 1;
+  const auto value = std::uint32_t(pending & mask);
+  pending >>= count;
+  pendingCount -= count;
+  return value;
+}
+
+std::uint64_t PackedInputArchive::readVarint() {
+  std::uint64_t value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    const std::uint32_t group = readBits(8);
+    value |= std::uint64_t(group & 0x7f) << shift;
+    if (!(group & 0x80)) return value;
+  }
+  throw cereal::Exception("Malformed variable-length integer!");
+}
+
+void PackedInputArchive::loadBinary(void *const data,
+                                    const std::size_t size) {
+  const auto bytes = (unsigned char *) data;
+  for (std::size_t i = 0; i < size; ++i)
+    bytes[i] = (unsigned char) readBits(8);
+}
+
+void PackedInputArchive::setBounds(const sf::Vector2f &dimensions) {
+  hasBounds = validBounds(dimensions);
+  bounds = dimensions;
+}
+
+float PackedInputArchive::readQuantized(const Quantum quantum,
+                                        const bool yAxis) {
+  QuantumRange range;
+  if (!getRange(quantum, yAxis, hasBounds, bounds, range)) {
+    float x;
+    detail::loadArithmetic(*this, x);
+    return x;
+  }
+
+  const std::uint32_t steps = maxQuantized(range.bits);
+  const std::uint32_t value = readBits(range.bits);
+  const float scale = (quantum == Quantum::Angle) ? float(steps + 1)
+                                                  : float(steps);
+  return range.min + (float(value) / scale) * (range.max - range.min);
+}
+
+/**
+ * Quantization helpers.
+ */
+
+void pack(PackedOutputArchive &ar, const char *, float &x, const Quantum q) {
+  ar.writeQuantized(x, q);
+}
+
+void pack(PackedInputArchive &ar, const char *, float &x, const Quantum q) {
+  x = ar.readQuantized(q);
+}
+
+void pack(PackedOutputArchive &ar, const char *, sf::Vector2f &x,
+          const Quantum q) {
+  ar.writeQuantized(x.x, q, false);
+  ar.writeQuantized(x.y, q, true);
+}
+
+void pack(PackedInputArchive &ar, const char *, sf::Vector2f &x,
+          const Quantum q) {
+  x.x = ar.readQuantized(q, false);
+  x.y = ar.readQuantized(q, true);
+}
+
+void setPackingBounds(PackedOutputArchive &ar, const sf::Vector2f &dims) {
+  ar.setBounds(dims);
+}
+
+void setPackingBounds(PackedInputArchive &ar, const sf::Vector2f &dims) {
+  ar.setBounds(dims);
+}
+
+/**
+ * Arithmetic types.
+ */
+
+namespace detail {
+
+void saveArithmetic(PackedOutputArchive &ar, const bool x) {
+  ar.writeBits(x ? 1 : 0, 1);
+}
+
+void saveArithmetic(PackedOutputArchive &ar, const float x) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  ar.writeBits(bits, 32);
+}
+
+void saveArithmetic(PackedOutputArchive &ar, const double x) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  ar.writeBits(std::uint32_t(bits), 32);
+  ar.writeBits(std::uint32_t(bits >> 32), 32);
+}
+
+void loadArithmetic(PackedInputArchive &ar, bool &x) {
+  x = ar.readBits(1) != 0;
+}
+
+void loadArithmetic(PackedInputArchive &ar, float &x) {
+  const std::uint32_t bits = ar.readBits(32);
+  std::memcpy(&x, &bits, sizeof(x));
+}
+
+void loadArithmetic(PackedInputArchive &ar, double &x) {
+  std::uint64_t bits = ar.readBits(32);
+  bits |= std::uint64_t(ar.readBits(32)) << 32;
+  std::memcpy(&x, &bits, sizeof(x));
+}
+
+}
+
+}
@@ -0,0 +1,232 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Compact cereal archives for the network protocol.
+ */
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <SFML/System.hpp>
+#include <cereal/cereal.hpp>
+
+namespace tg {
+
+/**
+ * Ways a float can be quantized on packed archives. Other archives store it
+ * as-is, so serialize templates can use the helpers below uniformly.
+ */
+enum class Quantum {
+  Unit, // [0, 1]
+  Angle, // [0, 360[, in degrees
+  AngularVelocity, // degrees per second
+  Position, // within the packing bounds (see setPackingBounds)
+  Velocity // pixels per second, scaled with the packing bounds
+};
+
+/**
+ * Output archive that writes at the bit level: bools take one bit,
+ * integers are variable-length, and floats can be quantized.
+ */
+class PackedOutputArchive:
+    public cereal::OutputArchive<PackedOutputArchive,
+                                 cereal::AllowEmptyClassElision> {
+ private:
+  std::ostream &stream;
+  std::uint64_t pending;
+  unsigned int pendingCount;
+
+  bool hasBounds;
+  sf::Vector2f bounds;
+
+ public:
+  PackedOutputArchive(std::ostream &stream);
+  PackedOutputArchive(const PackedOutputArchive &) = delete;
+  ~PackedOutputArchive();
+
+  // Writing.
+  void writeBits(const std::uint32_t value, const unsigned int count);
+  void writeVarint(std::uint64_t value);
+  void saveBinary(const void *data, const std::size_t size);
+  void flush();
+
+  // Quantization.
+  void setBounds(const sf::Vector2f &dimensions);
+  void writeQuantized(const float x, const Quantum quantum,
+                      const bool yAxis = false);
+
+};
+
+/**
+ * Input archive reading what PackedOutputArchive wrote.
+ */
+class PackedInputArchive:
+    public cereal::InputArchive<PackedInputArchive,
+                                cereal::AllowEmptyClassElision> {
+ private:
+  std::istream &stream;
+  std::uint64_t pending;
+  unsigned int pendingCount;
+
+  bool hasBounds;
+  sf::Vector2f bounds;
+
+ public:
+  PackedInputArchive(std::istream &stream);
+  PackedInputArchive(const PackedInputArchive &) = delete;
+
+  // Reading.
+  std::uint32_t readBits(const unsigned int count);
+  std::uint64_t readVarint();
+  void loadBinary(void *const data, const std::size_t size);
+
+  // Quantization.
+  void setBounds(const sf::Vector2f &dimensions);
+  float readQuantized(const Quantum quantum, const bool yAxis = false);
+
+};
+
+/**
+ * Serialize a float or vector, quantized on packed archives. The name is
+ * used by other archives, and can be null to leave the value unnamed.
+ */
+namespace detail {
+
+template<typename Archive, typename T>
+void packAs(Archive &ar, const char *name, T &x) {
+  if (name) ar(cereal::make_nvp(name, x));
+  else ar(x);
+}
+
+}
+
+template<typename Archive>
+void pack(Archive &ar, const char *name, float &x, const Quantum) {
+  detail::packAs(ar, name, x);
+}
+
+template<typename Archive>
+void pack(Archive &ar, const char *name, sf::Vector2f &x, const Quantum) {
+  detail::packAs(ar, name, x);
+}
+
+void pack(PackedOutputArchive &ar, const char *, float &x, const Quantum q);
+void pack(PackedInputArchive &ar, const char *, float &x, const Quantum q);
+void pack(PackedOutputArchive &ar, const char *, sf::Vector2f &x,
+          const Quantum q);
+void pack(PackedInputArchive &ar, const char *, sf::Vector2f &x,
+          const Quantum q);
+
+/**
+ * Set the map dimensions that positions and velocities are quantized
+ * against, for the rest of the archive. The dimensions must be serialized
+ * before this is called, so the reading end can do the same.
+ */
+template<typename Archive>
+void setPackingBounds(Archive &, const sf::Vector2f &) { }
+
+void setPackingBounds(PackedOutputArchive &ar, const sf::Vector2f &dims);
+void setPackingBounds(PackedInputArchive &ar, const sf::Vector2f &dims);
+
+/**
+ * Cereal serialization functions for the packed archives.
+ */
+namespace detail {
+
+void saveArithmetic(PackedOutputArchive &ar, const bool x);
+void saveArithmetic(PackedOutputArchive &ar, const float x);
+void saveArithmetic(PackedOutputArchive &ar, const double x);
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value
+                            && std::is_signed<T>::value>::type
+saveArithmetic(PackedOutputArchive &ar, const T x) {
+  // zigzag, so small negative numbers stay small
+  const auto wide = std::int64_t(x);
+  ar.writeVarint((std::uint64_t(wide) << 1) ^ std::uint64_t(wide >> 63));
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value
+                            && std::is_unsigned<T>::value>::type
+saveArithmetic(PackedOutputArchive &ar, const T x) {
+  ar.writeVarint(std::uint64_t(x));
+}
+
+void loadArithmetic(PackedInputArchive &ar, bool &x);
+void loadArithmetic(PackedInputArchive &ar, float &x);
+void loadArithmetic(PackedInputArchive &ar, double &x);
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value
+                            && std::is_signed<T>::value>::type
+loadArithmetic(PackedInputArchive &ar, T &x) {
+  const std::uint64_t raw = ar.readVarint();
+  x = T(std::int64_t(raw >> 1) ^ -std::int64_t(raw & 1));
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value
+                            && std::is_unsigned<T>::value>::type
+loadArithmetic(PackedInputArchive &ar, T &x) {
+  x = T(ar.readVarint());
+}
+
+}
+
+template<class T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, void>::type
+CEREAL_SAVE_FUNCTION_NAME(PackedOutputArchive &ar, T const &t) {
+  detail::saveArithmetic(ar, t);
+}
+
+template<class T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, void>::type
+CEREAL_LOAD_FUNCTION_NAME(PackedInputArchive &ar, T &t) {
+  detail::loadArithmetic(ar, t);
+}
+
+template<class Archive, class T>
+inline CEREAL_ARCHIVE_RESTRICT(PackedInputArchive, PackedOutputArchive)
+CEREAL_SERIALIZE_FUNCTION_NAME(Archive &ar, cereal::NameValuePair<T> &t) {
+  ar(t.value);
+}
+
+template<class Archive, class T>
+inline CEREAL_ARCHIVE_RESTRICT(PackedInputArchive, PackedOutputArchive)
+CEREAL_SERIALIZE_FUNCTION_NAME(Archive &ar, cereal::SizeTag<T> &t) {
+  ar(t.size);
+}
+
+template<class T>
+inline void CEREAL_SAVE_FUNCTION_NAME(PackedOutputArchive &ar,
+                                      cereal::BinaryData<T> const &bd) {
+  ar.saveBinary(bd.data, static_cast<std::size_t>(bd.size));
+}
+
+template<class T>
+inline void CEREAL_LOAD_FUNCTION_NAME(PackedInputArchive &ar,
+                                      cereal::BinaryData<T> &bd) {
+  ar.loadBinary(bd.data, static_cast<std::size_t>(bd.size));
+}
+
+}
+
+CEREAL_REGISTER_ARCHIVE(tg::PackedOutputArchive)
+CEREAL_REGISTER_ARCHIVE(tg::PackedInputArchive)
+CEREAL_SETUP_ARCHIVE_TRAITS(tg::PackedInputArchive, tg::PackedOutputArchive)
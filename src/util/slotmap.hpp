@@ -0,0 +1,211 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Dense, address-stable storage keyed by PID.
+ */
+#pragma once
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "util/types.hpp"
+
+/**
+ * A map from PID to T, for hot containers that are walked every tick.
+ *
+ * Values live in place in fixed-size chunks of slots, so iteration walks
+ * contiguous memory instead of chasing tree nodes, and a value never moves
+ * once emplaced (physics bodies and Subsystems keep pointers to them). A
+ * sorted vector maps PIDs to slots. Iteration is in slot order, not PID
+ * order.
+ *
+ * The interface is the subset of std::map that we use.
+ */
+template<typename T>
+class SlotMap {
+ public:
+  using key_type = PID;
+  using mapped_type = T;
+  using value_type = std::pair<const PID, T>;
+  static constexpr size_t chunkSize = 16;
+
+ private:
+  using Slot = optional<value_type>;
+  using Chunk = std::array<Slot, chunkSize>;
+  using Chunks = std::vector<std::unique_ptr<Chunk>>;
+  using Index = std::vector<std::pair<PID, size_t>>; // sorted by PID
+
+  Chunks chunks;
+  Index index;
+
+  Slot &slotAt(const size_t slot) const {
+    return (*chunks[slot / chunkSize])[slot % chunkSize];
+  }
+
+  typename Index::const_iterator lookup(const PID key) const {
+    return std::lower_bound(
+        index.begin(), index.end(), key,
+        [](const std::pair<PID, size_t> &entry, const PID key) {
+          return entry.first < key;
+        });
+  }
+
+  // Lowest free slot, so the occupied ones stay packed at the front.
+  size_t freeSlot() {
+    const size_t capacity = chunks.size() * chunkSize;
+    for (size_t slot = 0; slot < capacity; slot++) {
+      if (!slotAt(slot)) return slot;
+    }
+    chunks.emplace_back(std::make_unique<Chunk>());
+    return capacity;
+  }
+
+ public:
+  template<typename Value>
+  class Iterator {
+    friend class SlotMap;
+   private:
+    const Chunks *chunks;
+    size_t slot;
+
+    Iterator(const Chunks *chunks, const size_t slot) :
+        chunks(chunks), slot(slot) { skipEmpty(); }
+
+    Slot &at() const {
+      return (*(*chunks)[slot / chunkSize])[slot % chunkSize];
+    }
+
+    void skipEmpty() {
+      const size_t capacity = chunks->size() * chunkSize;
+      while (slot < capacity and !at()) ++slot;
+    }
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Value *;
+    using reference = Value &;
+
+    Value &operator*() const { return *at(); }
+    Value *operator->() const { return &*at(); }
+
+    Iterator &operator++() {
+      ++slot;
+      skipEmpty();
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator old{*this};
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const Iterator &other) const { return slot == other.slot; }
+    bool operator!=(const Iterator &other) const { return slot != other.slot; }
+
+  };
+
+  using iterator = Iterator<value_type>;
+  using const_iterator = Iterator<const value_type>;
+
+  SlotMap() = default;
+  SlotMap(const SlotMap &) = delete;
+  SlotMap &operator=(const SlotMap &) = delete;
+
+  iterator begin() { return {&chunks, 0}; }
+  iterator end() { return {&chunks, chunks.size() * chunkSize}; }
+  const_iterator begin() const { return {&chunks, 0}; }
+  const_iterator end() const { return {&chunks, chunks.size() * chunkSize}; }
+
+  size_t size() const { return index.size(); }
+  bool empty() const { return index.empty(); }
+
+  iterator find(const PID key) {
+    const auto entry = lookup(key);
+    if (entry == index.end() or entry->first != key) return end();
+    return {&chunks, entry->second};
+  }
+
+  const_iterator find(const PID key) const {
+    const auto entry = lookup(key);
+    if (entry == index.end() or entry->first != key) return end();
+    return {&chunks, entry->second};
+  }
+
+  size_t count(const PID key) const {
+    return (find(key) != end()) ? 1 : 0;
+  }
+
+  /**
+   * Like std::map::emplace(std::piecewise_construct, key, args): does
+   * nothing if the key is already present.
+   */
+  template<typename KeyTuple, typename ArgTuple>
+  std::pair<iterator, bool> emplace(std::piecewise_construct_t,
+                                    KeyTuple &&keyTuple,
+                                    ArgTuple &&argTuple) {
+    const PID key = std::get<0>(keyTuple);
+    const auto entry = lookup(key);
+    if (entry != index.end() and entry->first == key)
+      return {{&chunks, entry->second}, false};
+
+    const size_t slot = freeSlot();
+    slotAt(slot).emplace(std::piecewise_construct,
+                         std::forward_as_tuple(key),
+                         std::forward<ArgTuple>(argTuple));
+    index.emplace(entry, key, slot);
+    return {{&chunks, slot}, true};
+  }
+
+  void erase(const iterator iter) {
+    index.erase(lookup(iter->first));
+    slotAt(iter.slot).reset();
+  }
+
+  size_t erase(const PID key) {
+    const auto iter = find(key);
+    if (iter == end()) return 0;
+    erase(iter);
+    return 1;
+  }
+
+  void clear() {
+    index.clear();
+    chunks.clear();
+  }
+
+  // The smallest PID not in use.
+  PID smallestUnused() const {
+    PID i{0};
+    for (const auto &entry : index) {
+      if (entry.first == i) ++i;
+      else break;
+    }
+    return i;
+  }
+
+};
+
+template<typename T>
+PID smallestUnused(const SlotMap<T> &map) {
+  return map.smallestUnused();
+}
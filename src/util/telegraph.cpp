@@ -24,8 +24,10 @@ namespace tg {
  * UsageFlag.
  */
 static int enetUsageCount = 0;
+static std::mutex enetUsageMutex; // flags can live on several threads
 
 UsageFlag::UsageFlag() {
+  std::lock_guard<std::mutex> lock(enetUsageMutex);
   enetUsageCount++;
   if (enetUsageCount == 1) {
     if (enet_initialize() != 0)
@@ -35,6 +37,7 @@ UsageFlag::UsageFlag() {
 }
 
 UsageFlag::~UsageFlag() {
+  std::lock_guard<std::mutex> lock(enetUsageMutex);
   enetUsageCount--;
   if (enetUsageCount == 0) {
     enet_deinitialize();
@@ -42,24 +45,122 @@ UsageFlag::~UsageFlag() {
   }
 }
 
+/**
+ * PacketBuffer.
+ */
+
+std::streamsize PacketBuffer::xsputn(const char *s, std::streamsize n) {
+  bytes.insert(bytes.end(), s, s + n);
+  return n;
+}
+
+PacketBuffer::int_type PacketBuffer::overflow(int_type c) {
+  if (!traits_type::eq_int_type(c, traits_type::eof()))
+    bytes.push_back((unsigned char) c);
+  return traits_type::not_eof(c);
+}
+
+PacketBuffer::PacketBuffer(PacketPool &pool) :
+    pool(pool) { }
+
+void PacketBuffer::clear() {
+  bytes.clear(); // keeps the capacity, which is the point
+}
+
+const unsigned char *PacketBuffer::data() const {
+  return bytes.data();
+}
+
+size_t PacketBuffer::size() const {
+  return bytes.size();
+}
+
+/**
+ * SpanBuffer.
+ */
+
+SpanBuffer::SpanBuffer(const unsigned char *data, const size_t size) {
+  char *begin = (char *) data;
+  setg(begin, begin, begin + size);
+}
+
+/**
+ * PacketPool.
+ */
+
+void PacketPool::freePacket(ENetPacket *packet) {
+  auto buffer = (PacketBuffer *) packet->userData;
+  buffer->pool.release(std::unique_ptr<PacketBuffer>(buffer));
+}
+
+PacketPool::PacketPool(const size_t maxIdle) :
+    maxIdle(maxIdle) { }
+
+std::unique_ptr<PacketBuffer> PacketPool::acquire() {
+  if (idle.empty()) return std::make_unique<PacketBuffer>(*this);
+  auto buffer = std::move(idle.back());
+  idle.pop_back();
+  buffer->clear();
+  return buffer;
+}
+
+void PacketPool::release(std::unique_ptr<PacketBuffer> &&buffer) {
+  if (idle.size() < maxIdle) idle.push_back(std::move(buffer));
+}
+
+ENetPacket *PacketPool::wrap(std::unique_ptr<PacketBuffer> &&buffer,
+                             const enet_uint32 flags) {
+  ENetPacket *packet = enet_packet_create(
+      buffer->data(), buffer->size(), flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+  if (!packet) return nullptr;
+  packet->userData = buffer.release();
+  packet->freeCallback = &PacketPool::freePacket;
+  return packet;
+}
+
+size_t PacketPool::idleCount() const {
+  return idle.size();
+}
+
+/**
+ * PeerStats.
+ */
+
+PeerStats::PeerStats(const ENetPeer &peer) :
+    roundTrip(TimeDiff(peer.roundTripTime) / 1000.0f),
+    loss(float(peer.packetLoss) / float(ENET_PEER_PACKET_LOSS_SCALE)),
+    throttle(float(peer.packetThrottle)
+                 / float(ENET_PEER_PACKET_THROTTLE_SCALE)),
+    reliableInTransit(peer.reliableDataInTransit) { }
+
 /**
  * Host.
  */
 
+static const size_t noPeer = size_t(-1);
+
 void Host::registerPeer(ENetPeer *peer) {
-  auto found = std::find(peers.begin(), peers.end(), peer);
-  if (found != peers.end()) {
-    *found = peer;
+  const size_t slot = peer->incomingPeerID;
+  if (slot >= peerIndices.size()) peerIndices.resize(slot + 1, noPeer);
+
+  if (peerIndices[slot] != noPeer) {
+    peers[peerIndices[slot]] = peer;
   } else {
+    peerIndices[slot] = peers.size();
     peers.push_back(peer);
   }
 }
 
 void Host::unregisterPeer(ENetPeer *peer) {
-  auto found = std::find(peers.begin(), peers.end(), peer);
-  if (found != peers.end()) {
-    peers.erase(found);
-  }
+  const size_t slot = peer->incomingPeerID;
+  if (slot >= peerIndices.size() or peerIndices[slot] == noPeer) return;
+
+  // swap with the last peer, so removal is O(1)
+  const size_t index = peerIndices[slot];
+  peers[index] = peers.back();
+  peerIndices[peers[index]->incomingPeerID] = index;
+  peers.pop_back();
+  peerIndices[slot] = noPeer;
 }
 
 void Host::sampleBandwidth() {
@@ -69,8 +170,9 @@ void Host::sampleBandwidth() {
   host->totalSentData = 0;
 }
 
-Host::Host(const HostType type, const Port port) :
+Host::Host(const HostType type, const Port port, const size_t maxPeers) :
     host(nullptr),
+    lastReceived(nullptr),
     bandwidthSampler(1) {
   switch (type) {
     case HostType::Server: {
@@ -78,12 +180,13 @@ Host::Host(const HostType type, const Port port) :
       address.host = ENET_HOST_ANY;
       address.port = port;
       // no upstream / downstream bandwidth limits
-      host = enet_host_create(&address, 32, 1, 0, 0);
+      host = enet_host_create(&address, maxPeers, channelCount, 0, 0);
       break;
     }
     case HostType::Client: {
       // sensible upstream / downstream bandwidth limits
-      host = enet_host_create(nullptr, 2, 1, 57600 / 8, 14400 / 8);
+      host = enet_host_create(nullptr, 2, channelCount,
+                              57600 / 8, 14400 / 8);
       break;
     }
   }
@@ -96,10 +199,13 @@ Host::Host(const HostType type, const Port port) :
     throw std::runtime_error("Failed to create ENet host!");
   }
 
+  peerIndices.resize(host->peerCount, noPeer);
+
   sampleBandwidth();
 }
 
 Host::~Host() {
+  if (lastReceived) enet_packet_destroy(lastReceived);
   enet_host_destroy(host);
 }
 
@@ -111,7 +217,7 @@ ENetPeer *Host::connect(const std::string &address, const Port port) {
   ENetAddress eaddress;
   enet_address_set_host(&eaddress, address.c_str());
   eaddress.port = port;
-  ENetPeer *peer = enet_host_connect(host, &eaddress, 1, 0);
+  ENetPeer *peer = enet_host_connect(host, &eaddress, channelCount, 0);
   return peer;
 }
 
@@ -119,16 +225,39 @@ void Host::disconnect(ENetPeer *peer) {
   enet_peer_disconnect(peer, 0);
 }
 
-void Host::transmit(ENetPeer *const peer,
-                    unsigned char *data,
-                    size_t size,
-                    const ENetPacketFlag flag) {
-  ENetPacket *packet = enet_packet_create(data, size, flag);
-  enet_peer_send(peer, 0, packet);
+std::unique_ptr<PacketBuffer> Host::acquireBuffer() {
+  return packetPool.acquire();
+}
+
+ENetPacket *Host::makePacket(std::unique_ptr<PacketBuffer> &&buffer,
+                             const Channel channel) {
+  // no flags: unreliable, sequenced within its channel
+  return packetPool.wrap(
+      std::move(buffer),
+      (channel == Channel::Reliable) ? ENET_PACKET_FLAG_RELIABLE : 0);
+}
+
+void Host::transmit(ENetPeer *const peer, ENetPacket *const packet,
+                    const Channel channel) {
+  if (packet) enet_peer_send(peer, enet_uint8(channel), packet);
+}
+
+void Host::releasePacket(ENetPacket *const packet) {
+  // ENet takes ownership of packets it queues; others are ours to destroy.
+  if (packet && packet->referenceCount == 0) enet_packet_destroy(packet);
 }
 
-ENetEvent Host::poll() {
-  enet_host_service(host, &event, 0);
+ENetEvent Host::poll(const TimeDiff timeout) {
+  if (lastReceived) {
+    enet_packet_destroy(lastReceived);
+    lastReceived = nullptr;
+  }
+
+  enet_host_service(host, &event,
+                    enet_uint32(std::max(0.0f, timeout) * 1000.0f));
+
+  if (event.type == ENET_EVENT_TYPE_RECEIVE)
+    lastReceived = event.packet;
 
   if (event.type == ENET_EVENT_TYPE_CONNECT)
     registerPeer(event.peer);
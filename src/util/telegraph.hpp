@@ -20,13 +20,15 @@
  */
 #pragma once
 #include <sstream>
+#include <memory>
 #include <boost/range/iterator_range_core.hpp>
 #include <enet/enet.h>
 #include "util/types.hpp"
 #include "util/methods.hpp"
+#include "util/threads.hpp"
 #include "printer.hpp"
 
-#include <cereal/archives/binary.hpp>
+#include "util/packing.hpp"
 
 namespace tg {
 
@@ -40,17 +42,108 @@ struct UsageFlag {
   ~UsageFlag();
 };
 
+/**
+ * Growable byte buffer that packets are serialized into, exposed to cereal
+ * as an output streambuf. Owned by a PacketPool, which recycles it once ENet
+ * is done sending the packet that references it.
+ */
+class PacketBuffer: public std::streambuf {
+  friend class PacketPool;
+ private:
+  class PacketPool &pool;
+  std::vector<unsigned char> bytes;
+
+ protected:
+  // streambuf impl.
+  std::streamsize xsputn(const char *s, std::streamsize n) override;
+  int_type overflow(int_type c) override;
+
+ public:
+  PacketBuffer(class PacketPool &pool);
+
+  void clear();
+  const unsigned char *data() const;
+  size_t size() const;
+
+};
+
+/**
+ * Read-only streambuf over bytes we don't own, e.g. an ENetPacket's data.
+ */
+class SpanBuffer: public std::streambuf {
+ public:
+  SpanBuffer(const unsigned char *data, const size_t size);
+
+};
+
+/**
+ * Pool of PacketBuffers, and the glue that lets ENet send them without
+ * copying (ENET_PACKET_FLAG_NO_ALLOCATE).
+ */
+class PacketPool {
+ private:
+  std::vector<std::unique_ptr<PacketBuffer>> idle;
+  const size_t maxIdle;
+
+  static void freePacket(ENetPacket *packet);
+
+ public:
+  PacketPool(const size_t maxIdle = 64);
+  PacketPool(const PacketPool &) = delete;
+  PacketPool &operator=(const PacketPool &) = delete;
+
+  std::unique_ptr<PacketBuffer> acquire();
+  void release(std::unique_ptr<PacketBuffer> &&buffer);
+
+  // Create a packet referencing the buffer; it returns to the pool when
+  // ENet destroys the packet.
+  ENetPacket *wrap(std::unique_ptr<PacketBuffer> &&buffer,
+                   const enet_uint32 flags);
+
+  size_t idleCount() const;
+
+};
+
 /**
  * Host type: client or server.
  */
 enum class HostType { Client, Server };
 
+/**
+ * Channels that Hosts open. Reliable packets arrive in order; snapshots are
+ * unreliable, and ENet drops any that arrive after a newer one, so a lost
+ * snapshot never holds up the next.
+ */
+enum class Channel : enet_uint8 { Reliable = 0, Snapshot = 1 };
+
+const size_t channelCount = 2;
+
+/**
+ * Link quality of a peer, as ENet measures it.
+ */
+struct PeerStats {
+  PeerStats() = default; // an unmeasured link, with nothing wrong
+  PeerStats(const ENetPeer &peer);
+
+  TimeDiff roundTrip = 0; // mean round trip time
+  float loss = 0; // fraction of reliable packets lost
+  float throttle = 1; // fraction of unreliable packets ENet lets through
+  size_t reliableInTransit = 0; // bytes sent reliably and not yet acked
+
+};
+
 class Host {
  private:
   // Underlying state.
+  PacketPool packetPool;
   ENetHost *host;
   ENetEvent event;
+  ENetPacket *lastReceived; // destroyed on the next poll
+
+  // Connected peers, and their indices in `peers` by ENet slot
+  // (ENetPeer::incomingPeerID).
   std::vector<ENetPeer *> peers;
+  std::vector<size_t> peerIndices;
 
   // Bandwidth recording.
   Kbps lastIncomingBandwidth, lastOutgoingBandwidth;
@@ -65,18 +158,26 @@ class Host {
   Host(const Host &) = delete;
   Host &operator=(const Host &) = delete;
   Host(const HostType type,
-       const Port port = 0);
+       const Port port = 0,
+       const size_t maxPeers = 32); // for servers
   ~Host();
 
   // User API.
   const std::vector<ENetPeer *> &getPeers() const;
   ENetPeer *connect(const std::string &address, const Port port);
   void disconnect(ENetPeer *);
-  void transmit(ENetPeer *const peer,
-                unsigned char *data, size_t size,
-                const ENetPacketFlag flag);
 
-  ENetEvent poll();
+  // Packet transmission: serialize into a buffer from the pool, wrap it in
+  // a packet, send it to any number of peers, then release it.
+  std::unique_ptr<PacketBuffer> acquireBuffer();
+  ENetPacket *makePacket(std::unique_ptr<PacketBuffer> &&buffer,
+                         const Channel channel);
+  void transmit(ENetPeer *const peer, ENetPacket *const packet,
+                const Channel channel);
+  void releasePacket(ENetPacket *const packet);
+
+  // Poll for an event, blocking for at most `timeout` if none is queued.
+  ENetEvent poll(const TimeDiff timeout = 0);
   void tick(const TimeDiff delta);
 
   // Expressed in average kB per second.
@@ -92,17 +193,36 @@ template<typename ReceiveType>
 class Telegraph {
  private:
   ReceiveType receiveBuffer;
+  optional<sf::Vector2f> packingBounds;
 
  public:
   Telegraph() { }
 
-  // TODO: use the stringstream less stupidly?
+  /**
+   * Map dimensions to pack positions against in everything sent and
+   * received from now on, so packets needn't carry them; both ends must
+   * agree on them (see tg::setPackingBounds).
+   */
+  void setPackingBounds(const sf::Vector2f &dimensions) {
+    packingBounds = dimensions;
+  }
+
+  template<typename TransmitType>
+  void outputToBuffer(PacketBuffer &buffer, const TransmitType &x) {
+    std::ostream outputStream(&buffer);
+    PackedOutputArchive output(outputStream);
+    if (packingBounds) output.setBounds(*packingBounds);
+    output(x);
+  }
 
   template<typename TransmitType>
   std::string outputToString(const TransmitType &x) {
     std::stringstream outputStream;
-    cereal::BinaryOutputArchive output(outputStream);
-    output(x);
+    {
+      PackedOutputArchive output(outputStream);
+      if (packingBounds) output.setBounds(*packingBounds);
+      output(x);
+    } // flushes the last partial byte
     return outputStream.str();
   }
 
@@ -113,9 +233,9 @@ class Telegraph {
   void transmit(
       Host &host, ENetPeer *const peer,
       const TransmitType &value,
-      const bool guaranteeOrder = true) {
+      const Channel channel = Channel::Reliable) {
     transmit(host, [peer](auto f) { f(peer); },
-             value, guaranteeOrder);
+             value, channel);
   }
 
   /**
@@ -126,19 +246,21 @@ class Telegraph {
       Host &host,
       std::function<void(std::function<void(ENetPeer *const)>)> callPeers,
       const TransmitType &value,
-      const bool guaranteeOrder = true) {
-    std::string data = outputToString(value);
+      const Channel channel = Channel::Reliable) {
+    auto buffer = host.acquireBuffer();
+    outputToBuffer(*buffer, value);
+    ENetPacket *const packet = host.makePacket(std::move(buffer), channel);
     callPeers([&](ENetPeer *const peer) {
-      host.transmit(peer, (unsigned char *) data.c_str(), data.size(),
-                    (guaranteeOrder ? ENET_PACKET_FLAG_RELIABLE
-                                    : ENET_PACKET_FLAG_UNSEQUENCED));
+      host.transmit(peer, packet, channel);
     });
+    host.releasePacket(packet);
   }
 
   optional<ReceiveType> receive(const ENetPacket *packet) {
-    std::string data((const char *) packet->data, packet->dataLength);
-    std::stringstream inputStream(data);
-    cereal::BinaryInputArchive input(inputStream);
+    SpanBuffer data(packet->data, packet->dataLength);
+    std::istream inputStream(&data);
+    PackedInputArchive input(inputStream);
+    if (packingBounds) input.setBounds(*packingBounds);
 
     receiveBuffer = ReceiveType();
     try {
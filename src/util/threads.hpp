@@ -16,21 +16,24 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 /**
- * Gives us std::thread and std::mutex. If we're on MinGW, uses the thirdparty
- * mingw-std-threads library.
+ * Gives us std::thread, std::mutex and std::condition_variable. If we're on
+ * MinGW, uses the thirdparty mingw-std-threads library.
  */
 
 #ifdef __linux
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #endif
 
 #ifdef __APPLE__
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #endif
 
 #ifdef _WIN32
 #include <mingw.thread.h>
 #include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
 #endif
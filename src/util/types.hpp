@@ -19,6 +19,7 @@
  * Utilities in the form of types, useful for declarations.
  */
 #pragma once
+#include <functional>
 #include <vector>
 #include <numeric>
 #include <ratio>
@@ -84,6 +85,27 @@ void serialize(Archive &ar, sf::Vector2i &x) {
 #include <cereal/types/vector.hpp>
 #include <cereal/types/map.hpp>
 #include <cereal/types/utility.hpp>
+#include "util/packing.hpp"
+
+/**
+ * Optional float or vector, quantized on packed archives; serialized like
+ * optional<T> otherwise.
+ */
+template<typename Archive, typename T>
+void packOptional(Archive &ar, optional<T> &x, const tg::Quantum quantum) {
+  bool flag(x);
+  ar(flag);
+  if (flag) {
+    if (!x) x.emplace();
+    tg::pack(ar, nullptr, *x, quantum);
+  } else x.reset();
+}
+
+/**
+ * Told the progress of a long operation, in [0, 1]; returning false asks
+ * the operation to stop early.
+ */
+using ProgressMonitor = std::function<bool(const float progress)>;
 
 /**
  * Useful functions.
@@ -205,7 +227,7 @@ struct Cooldown {
   inline operator bool() const { return cooldown == 0; }
 
   template<typename Archive>
-  void serialize(Archive ar) {
+  void serialize(Archive &ar) {
     ar(cooldown);
   }
 };
@@ -225,7 +247,9 @@ struct Clamped {
   Clamped &operator-=(const float x);
 
   template<typename Archive>
-  void serialize(Archive &ar) { ar(value); }
+  void serialize(Archive &ar) {
+    tg::pack(ar, nullptr, value, tg::Quantum::Unit);
+  }
 
   inline operator float() const { return value; }
 };
@@ -277,7 +301,9 @@ struct Angle {
   Angle(const sf::Vector2f &);
 
   template<typename Archive>
-  void serialize(Archive &ar) { ar(cereal::make_nvp("angle", value.value)); }
+  void serialize(Archive &ar) {
+    tg::pack(ar, "angle", value.value, tg::Quantum::Angle);
+  }
 
   Angle &operator=(const float x);
   Angle &operator+=(const float x);
@@ -0,0 +1,106 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "workerpool.hpp"
+#include "util/printer.hpp"
+
+/**
+ * PoolJob.
+ */
+
+void PoolJob::run() {
+  if (!cancelled) {
+    try {
+      work(*this);
+    } catch (const std::exception &e) {
+      appLog("Uncaught exception in pool job: " + std::string(e.what()),
+             LogOrigin::Error);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+  finishedCondition.notify_all();
+}
+
+PoolJob::PoolJob(Work &&work) :
+    work(std::move(work)),
+    cancelled(false),
+    finished(false) {}
+
+void PoolJob::cancel() {
+  cancelled = true;
+}
+
+bool PoolJob::isCancelled() const {
+  return cancelled;
+}
+
+bool PoolJob::isFinished() const {
+  return finished;
+}
+
+void PoolJob::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  finishedCondition.wait(lock, [&]() { return bool(finished); });
+}
+
+/**
+ * WorkerPool.
+ */
+
+void WorkerPool::runWorker() {
+  while (true) {
+    std::shared_ptr<PoolJob> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobQueued.wait(lock, [&]() { return stopping or !queue.empty(); });
+      if (queue.empty()) return;
+      job = std::move(queue.front());
+      queue.pop_front();
+    }
+    job->run();
+  }
+}
+
+WorkerPool::WorkerPool(const size_t threadCount) :
+    stopping(false) {
+  for (size_t i = 0; i < threadCount; i++)
+    workers.emplace_back([this]() { runWorker(); });
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    for (auto &job : queue) job->cancel();
+  }
+  jobQueued.notify_all();
+  for (auto &worker : workers) worker.join();
+}
+
+std::shared_ptr<PoolJob> WorkerPool::submit(PoolJob::Work &&work) {
+  auto job = std::make_shared<PoolJob>(std::move(work));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(job);
+  }
+  jobQueued.notify_one();
+  return job;
+}
@@ -0,0 +1,79 @@
+/**
+ * solemnsky: the open-source multiplayer competitive 2D plane game
+ * Copyright (C) 2016  Chris Gadzinski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * A small pool of worker threads for background jobs.
+ */
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "util/threads.hpp"
+
+/**
+ * A job queued on a WorkerPool. Cancelling is cooperative: the job polls
+ * isCancelled() and stops early when it sees it.
+ */
+class PoolJob {
+  friend class WorkerPool;
+ public:
+  using Work = std::function<void(const PoolJob &)>;
+
+ private:
+  const Work work;
+  std::atomic<bool> cancelled, finished;
+  std::mutex mutex;
+  std::condition_variable finishedCondition;
+
+  void run();
+
+ public:
+  PoolJob(Work &&work);
+  PoolJob(const PoolJob &) = delete;
+
+  void cancel();
+  bool isCancelled() const;
+  bool isFinished() const;
+  // Block until the job has run (or been skipped, when it was cancelled).
+  void wait();
+
+};
+
+/**
+ * Fixed set of threads running queued PoolJobs in order. Jobs still queued
+ * when the pool is destroyed are cancelled.
+ */
+class WorkerPool {
+ private:
+  std::mutex mutex;
+  std::condition_variable jobQueued;
+  std::deque<std::shared_ptr<PoolJob>> queue;
+  bool stopping;
+  std::vector<std::thread> workers;
+
+  void runWorker();
+
+ public:
+  WorkerPool(const size_t threadCount);
+  WorkerPool(const WorkerPool &) = delete;
+  ~WorkerPool();
+
+  std::shared_ptr<PoolJob> submit(PoolJob::Work &&work);
+
+};
@@ -1,11 +1,12 @@
+#include <cstring>
 #include <fstream>
+#include <iterator>
 #include <gtest/gtest.h>
 #include "util/printer.hpp"
 #include "util/archive.hpp"
 
 /**
- * Our small 7zip wrapper for reading zip archives
- * does what one might expect it to.
+ * Our zip reader, and directory utilities, do what one might expect them to.
  */
 class ArchiveTest : public testing::Test {
  public:
@@ -53,7 +54,7 @@ TEST_F(ArchiveTest, DirectoryTest) {
 }
 
 /**
- * Archive lets us load archives asynchronously and get their contents as a Directory.
+ * Archive lets us load zip archives and read their files in memory.
  */
 TEST_F(ArchiveTest, ExtractTest) {
   {
@@ -61,14 +62,14 @@ TEST_F(ArchiveTest, ExtractTest) {
     Archive archive(getTestPath("archive-that-does-not-exist.zip")); // The test archive.
     ASSERT_EQ(archive.isDone(), false);
 
-    // Then we load the archive, and join the worker thread...
+    // Then we load the archive...
     archive.load(); // blocking call
 
     // And things are loaded.
     ASSERT_TRUE(archive.isDone());
 
-    // We get an error instead of a result because the path that we specified doesn't exist.
-    ASSERT_EQ((bool) archive.getResult(), false);
+    // We get an error because the path that we specified doesn't exist.
+    ASSERT_FALSE(archive.isOpen());
   }
 
   {
@@ -76,11 +77,53 @@ TEST_F(ArchiveTest, ExtractTest) {
     Archive archive(getTestPath("test.zip"));
     archive.load();
 
-    // Now it works.
-   ASSERT_EQ((bool) archive.getResult(), true);
-   const Directory &dir = *archive.getResult();
-   ASSERT_EQ(dir.name, "test.zip");
-   ASSERT_EQ(dir.files.size(), size_t(2));
+    // Now it works; directories aren't listed as files.
+    ASSERT_TRUE(archive.isOpen());
+    ASSERT_EQ(archive.getEntries().size(), size_t(2));
+
+    // Stored files read back as they were.
+    ASSERT_TRUE(bool(archive.readTopFile("asdf")));
+    EXPECT_EQ(*archive.readTopFile("asdf"), "asdf\n");
+    EXPECT_FALSE(bool(archive.readTopFile("does-not-exist")));
+  }
+
+  {
+    // Deflated files are inflated.
+    Archive archive(getTestPath("deflated.zip"));
+    archive.load();
+    ASSERT_TRUE(archive.isOpen());
+
+    const auto text = archive.readFile("subdirectory/text");
+    ASSERT_TRUE(bool(text));
+    EXPECT_EQ(text->size(), size_t(4000));
+    EXPECT_EQ(text->substr(0, 8), "solemnsk");
+
+    // readTopFile only finds files at the top.
+    EXPECT_FALSE(bool(archive.readTopFile("text")));
+  }
+
+  {
+    // A file claiming more than its data could inflate to isn't allocated.
+    std::ifstream original(getTestPath("deflated.zip").string(),
+                           std::ios::binary);
+    std::string zip((std::istreambuf_iterator<char>(original)),
+                    std::istreambuf_iterator<char>());
+    // The central directory comes last, and names follow its 46-byte records.
+    const size_t record = zip.rfind("subdirectory/text") - 46;
+    ASSERT_EQ(zip.compare(record, 4, "PK\x01\x02"), 0);
+    const unsigned char huge[4] = {0x00, 0x00, 0x00, 0xf0};
+    std::memcpy(&zip[record + 24], huge, sizeof(huge));
+
+    const auto path = fs::temp_directory_path() / "solemnsky-huge.zip";
+    {
+      std::ofstream patched(path.string(), std::ios::binary);
+      patched.write(zip.data(), zip.size());
+    }
+    Archive archive(path);
+    archive.load();
+    ASSERT_TRUE(archive.isOpen());
+    EXPECT_FALSE(bool(archive.readFile("subdirectory/text")));
+    fs::remove(path);
   }
 }
 
@@ -90,9 +133,8 @@ TEST_F(ArchiveTest, ExtractTest) {
 TEST_F(ArchiveTest, EnvironmentTest) {
   Archive archive(getEnvironmentPath("demo.sky"));
   archive.load();
-  ASSERT_TRUE((bool) archive.getResult());
+  ASSERT_TRUE(archive.isOpen());
 
-  const Directory &dir = *archive.getResult();
-  ASSERT_EQ(dir.files.size(), size_t(3));
-  ASSERT_TRUE(bool(dir.getTopFile("map.json")));
+  ASSERT_EQ(archive.getEntries().size(), size_t(3));
+  ASSERT_TRUE(bool(archive.readTopFile("map.json")));
 }
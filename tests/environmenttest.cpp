@@ -1,4 +1,7 @@
 #include "engine/environment/environment.hpp"
+#include "engine/environment/componentcache.hpp"
+#include <atomic>
+#include <cstring>
 #include <gtest/gtest.h>
 
 /**
@@ -20,6 +23,7 @@ TEST_F(EnvironmentTest, NullTest) {
 
   ASSERT_EQ(environment.loadingIdle(), true);
   ASSERT_EQ(environment.loadingErrored(), false);
+  EXPECT_FLOAT_EQ(environment.loadingProgress(), 1);
 
   // The map is loading, but graphics and scripts aren't.
   ASSERT_NE(environment.getMap(), nullptr);
@@ -93,3 +97,189 @@ TEST_F(EnvironmentTest, ScriptTest) {
   // TODO: more
 }
 
+
+/**
+ * Map obstacles decompose into pieces that physics can use directly.
+ */
+TEST_F(EnvironmentTest, DecomposeTest) {
+  // A 24-pointed star, with a duplicate vertex thrown in.
+  std::vector<sf::Vector2f> vertices;
+  for (int i = 0; i < 48; i++) {
+    const float radius = (i % 2) ? 20 : 50;
+    const float angle = 3.14159f * i / 24;
+    vertices.emplace_back(radius * std::cos(angle), radius * std::sin(angle));
+    if (i == 5) vertices.push_back(vertices.back());
+  }
+  sky::MapObstacle obstacle({}, vertices, 0);
+
+  ASSERT_FALSE(obstacle.decomposed.empty());
+  for (const auto &piece : obstacle.decomposed) {
+    EXPECT_GE(piece.size(), size_t(3));
+    EXPECT_LE(piece.size(), sky::MapObstacle::maxPieceVertices);
+  }
+
+  // A regular 20-gon is convex, but too big for one piece.
+  vertices.clear();
+  for (int i = 0; i < 20; i++) {
+    const float angle = 3.14159f * i / 10;
+    vertices.emplace_back(50 * std::cos(angle), 50 * std::sin(angle));
+  }
+  obstacle = sky::MapObstacle({}, vertices, 0);
+  EXPECT_EQ(obstacle.decomposed.size(), size_t(3));
+  for (const auto &piece : obstacle.decomposed)
+    EXPECT_LE(piece.size(), sky::MapObstacle::maxPieceVertices);
+}
+
+/**
+ * Maps cache their decomposition, and only trust a cache that matches.
+ */
+TEST_F(EnvironmentTest, DecompositionCacheTest) {
+  const std::string source = R"({
+    "dimensions": {"x": 1600, "y": 900},
+    "obstacles": [{"pos": {"x": 100, "y": 100}, "damage": 0,
+                   "localVertices": [{"x": 0, "y": 0}, {"x": 100, "y": 0},
+                                     {"x": 50, "y": 20}, {"x": 0, "y": 100}]}],
+    "spawnPoints": []
+  })";
+
+  std::istringstream input(source);
+  auto map = sky::Map::load(input);
+  ASSERT_TRUE(bool(map));
+  const auto pieces = map->getObstacles()[0].decomposed;
+  ASSERT_EQ(pieces.size(), size_t(2));
+
+  // The cache is written, and read back.
+  std::stringstream saved;
+  map->save(saved);
+  auto cachedMap = sky::Map::load(saved);
+  ASSERT_TRUE(bool(cachedMap));
+  EXPECT_EQ(cachedMap->getObstacles()[0].decomposed, pieces);
+
+  EXPECT_NE(saved.str().find("decomposition"), std::string::npos);
+
+  // A cache that matches the vertices is trusted, and one that doesn't isn't.
+  const auto withCache = [&](const uint64_t hash, const std::string &piece) {
+    std::string cached = source;
+    cached.replace(cached.rfind('}'), 1,
+                   ", \"decomposition\": [{\"hash\": " + std::to_string(hash)
+                       + ", \"pieces\": [" + piece + "]}]}");
+    std::istringstream input(cached);
+    return sky::Map::load(input)->getObstacles()[0].decomposed.size();
+  };
+  const std::string triangle =
+      R"([{"x": 0, "y": 0}, {"x": 10, "y": 0}, {"x": 0, "y": 10}])";
+  const auto hash = map->getObstacles()[0].geometryHash();
+  EXPECT_EQ(withCache(hash, triangle), size_t(1));
+  EXPECT_EQ(withCache(1, triangle), size_t(2));
+
+  // A matching cache with pieces physics can't take is decomposed anyway.
+  EXPECT_EQ(withCache(hash, R"([{"x": 0, "y": 0}, {"x": 10, "y": 0}])"),
+            size_t(2));
+  EXPECT_EQ(withCache(hash, R"([{"x": 0, "y": 0}, {"x": 10, "y": 0},
+                                {"x": 20, "y": 0}])"), size_t(2));
+  EXPECT_EQ(withCache(hash, R"([{"x": 0, "y": 0}, {"x": 10, "y": 0},
+                                {"x": 2, "y": 2}, {"x": 0, "y": 10}])"),
+            size_t(2));
+}
+
+/**
+ * Maps survive the binary format, and it rejects what it can't read.
+ */
+TEST_F(EnvironmentTest, BinaryMapTest) {
+  std::istringstream input(R"({
+    "dimensions": {"x": 2000, "y": 1000},
+    "obstacles": [{"pos": {"x": 100, "y": 100}, "damage": 1,
+                   "localVertices": [{"x": 0, "y": 0}, {"x": 100, "y": 0},
+                                     {"x": 50, "y": 20}, {"x": 0, "y": 100}]},
+                  {"pos": {"x": 500, "y": 300}, "damage": 0,
+                   "localVertices": [{"x": 0, "y": 0}, {"x": 10, "y": 0},
+                                     {"x": 0, "y": 10}]}],
+    "spawnPoints": [{"pos": {"x": 10, "y": 20}, "angle": {"angle": 1.5},
+                     "team": 2}]
+  })");
+  const auto map = sky::Map::load(input);
+  ASSERT_TRUE(bool(map));
+
+  std::ostringstream output;
+  map->saveBinary(output);
+  const std::string binary = output.str();
+  const auto data = (const unsigned char *) binary.data();
+
+  const auto loaded = sky::Map::loadBinary(data, binary.size());
+  ASSERT_TRUE(bool(loaded));
+  EXPECT_EQ(loaded->getDimensions(), map->getDimensions());
+  ASSERT_EQ(loaded->getObstacles().size(), size_t(2));
+  for (size_t i = 0; i < 2; i++) {
+    const auto &original = map->getObstacles()[i],
+        &copy = loaded->getObstacles()[i];
+    EXPECT_EQ(copy.pos, original.pos);
+    EXPECT_EQ(copy.damage, original.damage);
+    EXPECT_EQ(copy.localVertices, original.localVertices);
+    EXPECT_EQ(copy.decomposed, original.decomposed);
+  }
+  ASSERT_EQ(loaded->getSpawnPoints().size(), size_t(1));
+  EXPECT_EQ(loaded->getSpawnPoints()[0].pos, sf::Vector2f(10, 20));
+  EXPECT_EQ(loaded->getSpawnPoints()[0].team, sky::Team::Blue);
+  EXPECT_FLOAT_EQ(float(loaded->getSpawnPoints()[0].angle), 1.5f);
+
+  // A piece that physics can't take is decomposed again. The second
+  // obstacle's only piece is the last three vertices in the file.
+  std::string degenerate = binary;
+  std::memcpy(&degenerate[degenerate.size() - 2 * sizeof(sf::Vector2f)],
+              &degenerate[degenerate.size() - 3 * sizeof(sf::Vector2f)],
+              sizeof(sf::Vector2f));
+  const auto redone = sky::Map::loadBinary(
+      (const unsigned char *) degenerate.data(), degenerate.size());
+  ASSERT_TRUE(bool(redone));
+  EXPECT_EQ(redone->getObstacles()[1].decomposed,
+            map->getObstacles()[1].decomposed);
+
+  // Truncation and foreign data are refused.
+  EXPECT_FALSE(bool(sky::Map::loadBinary(data, binary.size() - 1)));
+  EXPECT_FALSE(bool(sky::Map::loadBinary(data, 10)));
+  std::string foreign = binary;
+  foreign[0] = 'X';
+  EXPECT_FALSE(bool(sky::Map::loadBinary(
+      (const unsigned char *) foreign.data(), foreign.size())));
+}
+
+/**
+ * ComponentCache loads each key once, even when asked from several threads,
+ * and keeps the most recently used.
+ */
+TEST_F(EnvironmentTest, ComponentCacheTest) {
+  sky::ComponentCache<int, int> cache(2);
+  std::atomic<int> loads(0);
+  const auto loader = [&](const int value) {
+    return [&loads, value]() {
+      ++loads;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      return std::make_shared<const int>(value);
+    };
+  };
+
+  std::vector<std::thread> threads;
+  std::vector<std::shared_ptr<const int>> results(4);
+  for (size_t i = 0; i < results.size(); i++) {
+    threads.emplace_back([&, i]() { results[i] = cache.get(1, loader(1)); });
+  }
+  for (auto &thread : threads) thread.join();
+
+  EXPECT_EQ(loads, 1);
+  for (const auto &result : results) EXPECT_EQ(result, results[0]);
+
+  // Failures aren't cached.
+  EXPECT_EQ(cache.get(2, []() { return nullptr; }), nullptr);
+  EXPECT_EQ(cache.size(), size_t(1));
+
+  // Least recently used entries go first.
+  cache.get(2, loader(2));
+  cache.get(1, loader(1));
+  cache.get(3, loader(3));
+  EXPECT_EQ(cache.size(), size_t(2));
+  EXPECT_EQ(loads, 3);
+  EXPECT_EQ(*cache.get(1, loader(1)), 1);
+  EXPECT_EQ(loads, 3);
+  EXPECT_EQ(*cache.get(2, loader(2)), 2);
+  EXPECT_EQ(loads, 4);
+}
@@ -41,3 +41,60 @@ TEST_F(FlowTest, BasicTest) {
     ASSERT_FALSE(bool(control.pull(20.5)));
   }
 }
+
+/**
+ * A one-dimensional position, to buffer.
+ */
+struct Position {
+  Position(const float x = 0, const float vel = 0) : x(x), vel(vel) { }
+
+  float x, vel;
+
+  static Position interpolate(const Position &from, const Position &to,
+                              const float t) {
+    return Position(from.x + t * (to.x - from.x), to.vel);
+  }
+
+  Position extrapolate(const TimeDiff delta) const {
+    return Position(x + delta * vel, vel);
+  }
+};
+
+/**
+ * SnapshotBuffer blends between snapshots some delay behind the sender.
+ */
+TEST_F(FlowTest, SnapshotTest) {
+  sky::SnapshotBuffer<Position> buffer({});
+  ASSERT_FALSE(bool(buffer.sample(0, 0)));
+
+  // Snapshots every 0.1 seconds, arriving with a steady 0.05 second transit;
+  // our clock is 10 seconds ahead of the sender's.
+  for (int i = 0; i < 5; i++)
+    buffer.push(0.1 * i, Position(float(i), 10), 10.05 + 0.1 * i);
+  EXPECT_FLOAT_EQ(buffer.getJitter(), 0);
+  EXPECT_NEAR(buffer.getDelay(), 0.1, 0.001);
+
+  // Out-of-order snapshots are dropped.
+  buffer.push(0.25, Position(100, 0), 10.45);
+
+  {
+    const auto sample = buffer.sample(10.25, 10);
+    ASSERT_TRUE(bool(sample));
+    EXPECT_NEAR(sample->x, 1.5, 0.01);
+  }
+
+  // Past the newest snapshot we extrapolate, but not too far.
+  {
+    const auto sample = buffer.sample(10.55, 10);
+    ASSERT_TRUE(bool(sample));
+    EXPECT_NEAR(sample->x, 4.5, 0.01);
+    EXPECT_NEAR(buffer.sample(20, 10)->x, 5, 0.01);
+  }
+
+  // Uneven arrivals widen the delay.
+  sky::SnapshotBuffer<Position> jittery({});
+  for (int i = 0; i < 20; i++)
+    jittery.push(0.1 * i, Position(float(i)), 0.1 * i + ((i % 2) ? 0.1 : 0));
+  EXPECT_GT(jittery.getJitter(), 0.01);
+  EXPECT_GT(jittery.getDelay(), 0.12);
+}
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <sstream>
+#include <gtest/gtest.h>
+#include "server/interest.hpp"
+
+namespace {
+
+sky::Map wideMap() {
+  std::istringstream source(R"({
+    "dimensions": {"x": 6000, "y": 900},
+    "obstacles": [],
+    "spawnPoints": []
+  })");
+  return *sky::Map::load(source);
+}
+
+bool contains(const std::vector<PID> &pids, const PID pid) {
+  return std::find(pids.begin(), pids.end(), pid) != pids.end();
+}
+
+}
+
+/**
+ * The server sends each client frequent deltas only for the planes near it.
+ */
+class InterestTest: public testing::Test {
+ public:
+  sky::Arena arena;
+  sky::Map map;
+  sky::Sky sky;
+  InterestTracker interest;
+
+  InterestTest() :
+      arena(sky::ArenaInit("special arena", "NULL", sky::ArenaMode::Lobby)),
+      map(wideMap()),
+      sky(arena, map, sky::SkyInit()),
+      interest(arena) {}
+
+  sky::Player &spawnAt(const std::string &nick, const sf::Vector2f &pos) {
+    arena.connectPlayer(nick);
+    sky::Player &player = *arena.getPlayer(arena.getPlayers().size() - 1);
+    player.spawn({}, pos, 0);
+    return player;
+  }
+
+  void moveTo(sky::Player &player, const sf::Vector2f &pos) {
+    sky.getParticipation(player).displayPhysical(
+        sky::PhysicalState(pos, {}, 0, 0));
+  }
+
+};
+
+/**
+ * InterestGrid finds the planes in an area, including those off the map.
+ */
+TEST_F(InterestTest, GridTest) {
+  InterestGrid grid({1000, 1000}, 100);
+  grid.insert(0, {50, 50});
+  grid.insert(1, {250, 250});
+  grid.insert(2, {-100, 500}); // off the map, in the edge cells
+  grid.insert(3, {950, 950});
+
+  const auto query = [&](const sf::FloatRect &area) {
+    std::vector<PID> pids;
+    grid.query(area, pids);
+    std::sort(pids.begin(), pids.end());
+    return pids;
+  };
+
+  EXPECT_EQ(query({0, 0, 300, 300}), std::vector<PID>({0, 1}));
+  // Planes in an edge cell, but outside the area, are left out.
+  EXPECT_EQ(query({260, 260, 100, 100}), std::vector<PID>());
+  EXPECT_EQ(query({-200, 400, 300, 200}), std::vector<PID>({2}));
+  EXPECT_EQ(query({-1000, -1000, 3000, 3000}),
+            std::vector<PID>({0, 1, 2, 3}));
+
+  grid.clear();
+  EXPECT_EQ(query({-1000, -1000, 3000, 3000}), std::vector<PID>());
+}
+
+/**
+ * Planes enter interest near a player's view, and only leave it once they're
+ * well clear, so one on the edge doesn't flicker in and out.
+ */
+TEST_F(InterestTest, TrackerTest) {
+  // the view is 1600 wide, so it spans 0 to 1600 here
+  sky::Player &player = spawnAt("player", {800, 450});
+  sky::Player &other = spawnAt("other", {1800, 450});
+  const float enterAt = 1600 + interest.settings.viewMargin,
+      leaveAt = 1600 + interest.settings.leaveMargin;
+  ASSERT_LT(enterAt, leaveAt);
+
+  interest.update(sky);
+  const auto &seen = interest.getInterest(player);
+  EXPECT_EQ(seen.near, std::vector<PID>({player.pid, other.pid}));
+  EXPECT_EQ(seen.entered, std::vector<PID>({player.pid, other.pid}));
+
+  // Between the margins, it stays.
+  moveTo(other, {(enterAt + leaveAt) / 2, 450});
+  interest.update(sky);
+  EXPECT_TRUE(contains(seen.near, other.pid));
+  EXPECT_TRUE(seen.entered.empty());
+  EXPECT_TRUE(seen.left.empty());
+
+  // Past the wider margin, it leaves.
+  moveTo(other, {leaveAt + 100, 450});
+  interest.update(sky);
+  EXPECT_FALSE(contains(seen.near, other.pid));
+  EXPECT_EQ(seen.left, std::vector<PID>({other.pid}));
+
+  // Back between the margins, it hasn't entered again yet.
+  moveTo(other, {(enterAt + leaveAt) / 2, 450});
+  interest.update(sky);
+  EXPECT_FALSE(contains(seen.near, other.pid));
+  EXPECT_TRUE(seen.entered.empty());
+
+  moveTo(other, {enterAt - 100, 450});
+  interest.update(sky);
+  EXPECT_EQ(seen.entered, std::vector<PID>({other.pid}));
+
+  // Without a plane, a player is interested in everyone.
+  sky.getParticipation(player).suicide();
+  moveTo(other, {5000, 450});
+  interest.update(sky);
+  EXPECT_EQ(seen.near, std::vector<PID>({other.pid}));
+}
+
+/**
+ * A player's deltas carry their own participation, the near ones, the ones
+ * that have to arrive, and distant ones in turn.
+ */
+TEST_F(InterestTest, SelectTest) {
+  sky::Player &player = spawnAt("player", {800, 450});
+  sky::Player &near = spawnAt("near", {1000, 450});
+  sky::Player &far = spawnAt("far", {5000, 450});
+
+  // Spawns go reliably, so they're all sent.
+  interest.update(sky);
+  auto selected =
+      interest.selectParticipations(player, sky.collectDelta(), false);
+  EXPECT_EQ(selected.size(), size_t(3));
+
+  const auto delta = sky.collectDelta();
+  ASSERT_FALSE(delta.needsReliable());
+  selected = interest.selectParticipations(player, delta, false);
+  EXPECT_TRUE(contains(selected, player.pid));
+  EXPECT_TRUE(contains(selected, near.pid));
+  EXPECT_FALSE(contains(selected, far.pid));
+
+  // The far plane gets its turn once every distantInterval updates.
+  unsigned int turns = 0;
+  for (unsigned int i = 0; i < interest.settings.distantInterval; i++) {
+    interest.update(sky);
+    if (contains(interest.selectParticipations(player, delta), far.pid))
+      ++turns;
+  }
+  EXPECT_EQ(turns, 1u);
+
+  // The filtered delta has just what was selected.
+  const auto filtered = InterestTracker::filter(delta, selected);
+  EXPECT_EQ(filtered.participations.size(), selected.size());
+  EXPECT_EQ(filtered.participations.count(far.pid), size_t(0));
+
+  // A death has to arrive, however far.
+  sky.getParticipation(far).suicide();
+  selected = interest.selectParticipations(player, sky.collectDelta(), false);
+  EXPECT_TRUE(contains(selected, far.pid));
+}
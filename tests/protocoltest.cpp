@@ -4,6 +4,7 @@
 #include "util/printer.hpp"
 #include <gtest/gtest.h>
 #include <cereal/archives/binary.hpp>
+#include "util/packing.hpp"
 
 /**
  * Our multiplayer protocol verbs encode all network communication, and are
@@ -55,6 +56,43 @@ TEST_F(ProtocolTest, CerealProtocol) {
     EXPECT_EQ(packet.stringData.get(), "hey");
   }
 
+  {
+    output(sky::ClientPacket::ReqJoin("hey", std::string("other arena")));
+    sky::ClientPacket packet;
+    input(packet);
+    EXPECT_EQ(packet.verifyStructure(), true);
+    EXPECT_EQ(packet.arenaName.get(), "other arena");
+  }
+
+  {
+    output(sky::ServerPacket::Redirect("other arena", 4243));
+    sky::ServerPacket packet;
+    input(packet);
+    EXPECT_EQ(packet.verifyStructure(), true);
+    EXPECT_EQ(packet.type, sky::ServerPacket::Type::Redirect);
+    EXPECT_EQ(packet.port.get(), 4243);
+  }
+
+  {
+    output(sky::ServerPacket::SkyInterest({1, 4}, {2}));
+    sky::ServerPacket packet;
+    input(packet);
+    EXPECT_EQ(packet.verifyStructure(), true);
+    EXPECT_EQ(packet.entered.get(), std::vector<PID>({1, 4}));
+    EXPECT_EQ(packet.left.get(), std::vector<PID>({2}));
+  }
+
+  {
+    sky::SkyPropSpawns spawns;
+    spawns.props[2].emplace(0, sky::PropInit({100, 200}, {0, 50}));
+    output(sky::ServerPacket::SpawnProps(spawns, 5));
+    sky::ServerPacket packet;
+    input(packet);
+    EXPECT_EQ(packet.verifyStructure(), true);
+    EXPECT_EQ(packet.propSpawns->props.at(2).at(0).physical.pos.x, 100);
+    EXPECT_EQ(packet.timestamp.get(), 5);
+  }
+
   {
     output(sky::ClientPacket::ReqSpawn());
     sky::ClientPacket packet;
@@ -89,3 +127,73 @@ TEST_F(ProtocolTest, Invariant) {
 
 }
 
+
+/**
+ * The packed archive round-trips what the protocol sends, and is
+ * considerably smaller than the plain binary encoding.
+ */
+TEST_F(ProtocolTest, Packing) {
+  const sf::Vector2f dims{1600, 900};
+
+  sky::PlaneState state;
+  state.physical.pos = {400, 300};
+  state.physical.vel = {-120, 55.5};
+  state.physical.rot = 90;
+  state.physical.rotvel = -180;
+  state.stalled = true;
+  state.throttle = 0.25;
+  state.health = 0.5;
+
+  std::stringstream packedStream;
+  {
+    tg::PackedOutputArchive packed(packedStream);
+    packed(dims);
+    tg::setPackingBounds(packed, dims);
+    packed(state, std::string("hey"), -3, 300u);
+  }
+
+  output(dims, state, std::string("hey"), -3, 300u);
+  EXPECT_LT(packedStream.str().size(), stream.str().size() / 2);
+
+  sf::Vector2f readDims;
+  sky::PlaneState readState;
+  std::string readString;
+  int readInt;
+  unsigned int readUnsigned;
+  {
+    tg::PackedInputArchive packed(packedStream);
+    packed(readDims);
+    tg::setPackingBounds(packed, readDims);
+    packed(readState, readString, readInt, readUnsigned);
+  }
+
+  EXPECT_EQ(readDims, dims);
+  EXPECT_NEAR(readState.physical.pos.x, 400, 0.01);
+  EXPECT_NEAR(readState.physical.pos.y, 300, 0.01);
+  EXPECT_NEAR(readState.physical.vel.x, -120, 0.1);
+  EXPECT_NEAR(readState.physical.vel.y, 55.5, 0.1);
+  EXPECT_NEAR(readState.physical.rot, 90, 0.01);
+  EXPECT_NEAR(readState.physical.rotvel, -180, 0.05);
+  EXPECT_EQ(readState.stalled, true);
+  EXPECT_NEAR(readState.throttle, 0.25, 0.001);
+  EXPECT_NEAR(readState.health, 0.5, 0.001);
+  EXPECT_EQ(readString, "hey");
+  EXPECT_EQ(readInt, -3);
+  EXPECT_EQ(readUnsigned, 300u);
+
+  // out-of-range values are clamped rather than wrapped
+  state.physical.pos = {-1e6f, 1e6f};
+  std::stringstream clampStream;
+  {
+    tg::PackedOutputArchive packed(clampStream);
+    tg::setPackingBounds(packed, dims);
+    packed(state);
+  }
+  {
+    tg::PackedInputArchive packed(clampStream);
+    tg::setPackingBounds(packed, dims);
+    packed(readState);
+  }
+  EXPECT_NEAR(readState.physical.pos.x, -dims.x / 2, 0.01);
+  EXPECT_NEAR(readState.physical.pos.y, dims.y * 1.5f, 0.01);
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "server/ratecontrol.hpp"
+
+/**
+ * RateControl backs a congested client's snapshots off, and brings them back
+ * when its link recovers.
+ */
+class RateControlTest: public testing::Test {
+ public:
+  sky::Arena arena;
+  RateControl rates;
+
+  RateControlTest() :
+      arena(sky::ArenaInit("special arena", "NULL", sky::ArenaMode::Lobby)),
+      rates(arena) {
+    arena.connectPlayer("nameless plane");
+  }
+
+  sky::Player &player() { return *arena.getPlayer(0); }
+
+  // A link that's fine, with a given round trip.
+  static tg::PeerStats fine(const TimeDiff roundTrip = 0.1) {
+    tg::PeerStats stats;
+    stats.roundTrip = roundTrip;
+    return stats;
+  }
+
+};
+
+/**
+ * Each sign of congestion doubles the interval, up to the maximum, and it
+ * recovers step by step.
+ */
+TEST_F(RateControlTest, AdaptTest) {
+  const auto &settings = rates.settings;
+  rates.adapt(player(), fine());
+  ASSERT_FLOAT_EQ(rates.getInterval(player()), settings.minInterval);
+  ASSERT_FALSE(rates.isDegraded(player()));
+
+  auto queueing = fine(0.1f + settings.maxQueueing + 0.05f),
+      lossy = fine(), throttled = fine(), backlogged = fine();
+  lossy.loss = settings.maxLoss * 2;
+  throttled.throttle = settings.minThrottle / 2;
+  backlogged.reliableInTransit = settings.maxReliableInTransit * 2;
+
+  for (const auto &congested : {queueing, lossy, throttled, backlogged}) {
+    rates.adapt(player(), congested);
+    EXPECT_FLOAT_EQ(rates.getInterval(player()), 2 * settings.minInterval);
+    rates.adapt(player(), congested);
+    EXPECT_FLOAT_EQ(rates.getInterval(player()), 4 * settings.minInterval);
+    EXPECT_TRUE(rates.isDegraded(player()));
+
+    rates.adapt(player(), fine());
+    EXPECT_NEAR(rates.getInterval(player()),
+                4 * settings.minInterval - settings.recoveryStep, 0.0001);
+    for (int i = 0; i < 20; i++) rates.adapt(player(), fine());
+    EXPECT_FLOAT_EQ(rates.getInterval(player()), settings.minInterval);
+    EXPECT_FALSE(rates.isDegraded(player()));
+  }
+
+  for (int i = 0; i < 10; i++) rates.adapt(player(), lossy);
+  EXPECT_FLOAT_EQ(rates.getInterval(player()), settings.maxInterval);
+}
+
+/**
+ * The round trip queueing is measured against is the lowest of a recent
+ * window, so a route that got slower for good stops counting as congested.
+ */
+TEST_F(RateControlTest, RoundTripWindowTest) {
+  const auto &settings = rates.settings;
+  rates.adapt(player(), fine(0.05));
+
+  const auto slower = fine(0.05f + settings.maxQueueing + 0.1f);
+  for (unsigned int i = 1; i < settings.roundTripWindow; i++)
+    rates.adapt(player(), slower);
+  EXPECT_FLOAT_EQ(rates.getInterval(player()), settings.maxInterval);
+
+  for (int i = 0; i < 30; i++) rates.adapt(player(), slower);
+  EXPECT_FALSE(rates.isDegraded(player()));
+}
+
+/**
+ * Snapshots are due once per interval, a little early rather than late.
+ */
+TEST_F(RateControlTest, SnapshotDueTest) {
+  const TimeDiff tick = rates.settings.minInterval;
+  for (int i = 0; i < 5; i++) EXPECT_TRUE(rates.snapshotDue(player(), tick));
+
+  tg::PeerStats lossy = fine();
+  lossy.loss = 1;
+  rates.adapt(player(), lossy);
+  rates.adapt(player(), lossy);
+  ASSERT_FLOAT_EQ(rates.getInterval(player()), 4 * tick);
+
+  int due = 0;
+  for (int i = 0; i < 40; i++) {
+    if (rates.snapshotDue(player(), tick)) {
+      EXPECT_EQ(i % 4, 0);
+      ++due;
+    }
+  }
+  EXPECT_EQ(due, 10);
+
+  // Recovering shortens the wait already under way.
+  for (int i = 0; i < 20; i++) rates.adapt(player(), fine());
+  EXPECT_TRUE(rates.snapshotDue(player(), tick));
+}
+
+/**
+ * What's held back between snapshots is taken all at once, the newest for
+ * each participation and prop.
+ */
+TEST_F(RateControlTest, HoldTest) {
+  rates.holdKeyframe(player(), 3, false);
+  rates.holdKeyframe(player(), 3, true);
+  rates.holdKeyframe(player(), 3, false);
+  rates.holdKeyframe(player(), 4, false);
+  EXPECT_EQ(rates.takeHeldKeyframes(player()),
+            (std::map<PID, bool>{{3, true}, {4, false}}));
+  EXPECT_TRUE(rates.takeHeldKeyframes(player()).empty());
+
+  sky::SkyPropSpawns first, second;
+  first.props[1][0] = sky::PropInit({10, 10}, {});
+  second.props[1][0] = sky::PropInit({20, 20}, {});
+  second.props[1][1] = sky::PropInit({30, 30}, {});
+  rates.holdProps(player(), first);
+  rates.holdProps(player(), second);
+
+  const auto held = rates.takeHeldProps(player());
+  ASSERT_EQ(held.props.size(), size_t(1));
+  ASSERT_EQ(held.props.at(1).size(), size_t(2));
+  EXPECT_EQ(held.props.at(1).at(0).physical.pos, sf::Vector2f(20, 20));
+  EXPECT_TRUE(rates.takeHeldProps(player()).isEmpty());
+}
@@ -1,5 +1,25 @@
+#include <set>
+#include <sstream>
 #include <gtest/gtest.h>
 #include "engine/sky/sky.hpp"
+#include "engine/flowcontrol.hpp"
+
+namespace {
+
+/**
+ * Ignores physical events, for tests on a bare Physics.
+ */
+class QuietListener: public sky::PhysicsListener {
+ protected:
+  void onBeginContact(const sky::BodyTag &, const sky::BodyTag &) override { }
+  void onEndContact(const sky::BodyTag &, const sky::BodyTag &) override { }
+  bool enableContact(const sky::BodyTag &, const sky::BodyTag &) override {
+    return true;
+  }
+
+};
+
+}
 
 /**
  * The Sky subsystem operates and networks correctly.
@@ -121,6 +141,131 @@ TEST_F(SkyTest, AuthorityTest) {
 
 }
 
+/**
+ * The client predicts the server's fields for its own plane: it replays the
+ * ticks the server hasn't acked over the server's state.
+ */
+TEST_F(SkyTest, PredictionTest) {
+  arena.connectPlayer("nameless plane");
+  auto &player = *arena.getPlayer(0);
+  auto &participation = sky.getParticipation(player);
+
+  sky::Arena remoteArena{arena.captureInitializer()};
+  sky::Sky remoteSky{remoteArena, nullMap, sky.captureInitializer()};
+  auto &remoteParticip = remoteSky.getParticipation(*remoteArena.getPlayer(0));
+
+  player.spawn({}, {200, 200}, 0);
+  remoteSky.applyDelta(sky.collectDelta().respectAuthority(player));
+  participation.applyInput(remoteParticip.collectInput().get());
+
+  // The server spends energy; the client has ticked twice since its input.
+  ASSERT_TRUE(participation.plane->requestDiscreteEnergy(0.3));
+  remoteArena.tick(0.05);
+  remoteArena.tick(0.05);
+  remoteSky.applyDelta(sky.collectDelta().respectAuthority(player));
+
+  const float recharge = participation.plane->getTuning().energy.recharge;
+  EXPECT_NEAR(remoteParticip.plane->getState().energy,
+              0.7f + 0.1f * recharge, 0.001f);
+
+  // Once the server has seen those ticks, its state stands as it is.
+  participation.applyInput(remoteParticip.collectInput().get());
+  remoteSky.applyDelta(sky.collectDelta().respectAuthority(player));
+  EXPECT_NEAR(remoteParticip.plane->getState().energy, 0.7f, 0.001f);
+}
+
+/**
+ * Ticks the server has run since applying the acked input are already in its
+ * state, so the client doesn't replay its own copies of them on top.
+ */
+TEST_F(SkyTest, ServerAheadTest) {
+  arena.connectPlayer("nameless plane");
+  auto &player = *arena.getPlayer(0);
+  auto &participation = sky.getParticipation(player);
+
+  sky::Arena remoteArena{arena.captureInitializer()};
+  sky::Sky remoteSky{remoteArena, nullMap, sky.captureInitializer()};
+  auto &remoteParticip = remoteSky.getParticipation(*remoteArena.getPlayer(0));
+
+  player.spawn({}, {200, 200}, 0);
+  remoteSky.applyDelta(sky.collectDelta().respectAuthority(player));
+  ASSERT_TRUE(participation.plane->requestDiscreteEnergy(0.3));
+  remoteSky.applyDelta(sky.collectDelta().respectAuthority(player));
+  participation.applyInput(remoteParticip.collectInput().get());
+
+  // Both sides tick twice before the server's next delta.
+  for (int i = 0; i < 2; i++) {
+    arena.tick(0.05);
+    remoteArena.tick(0.05);
+  }
+  remoteSky.applyDelta(sky.collectDelta().respectAuthority(player));
+
+  const float recharge = participation.plane->getTuning().energy.recharge;
+  EXPECT_NEAR(participation.plane->getState().energy,
+              0.7f + 0.1f * recharge, 0.001f);
+  EXPECT_NEAR(remoteParticip.plane->getState().energy,
+              participation.plane->getState().energy, 0.001f);
+}
+
+/**
+ * ParticipationDeltas only carry the plane fields that changed since the last
+ * keyframe, and only keyframes and structural changes need to be reliable.
+ */
+TEST_F(SkyTest, DeltaTest) {
+  arena.connectPlayer("nameless plane");
+  auto &player = *arena.getPlayer(0);
+  auto &participation = sky.getParticipation(player);
+
+  sky::Arena remoteArena{arena.captureInitializer()};
+  sky::Sky remoteSky{remoteArena, nullMap, sky.captureInitializer()};
+  auto &remoteParticip = remoteSky.getParticipation(*remoteArena.getPlayer(0));
+
+  player.spawn({}, {200, 200}, 0);
+  {
+    const auto delta = sky.collectDelta();
+    ASSERT_EQ(delta.needsReliable(), true);
+    remoteSky.applyDelta(delta);
+    ASSERT_EQ(remoteParticip.isSpawned(), true);
+  }
+
+  // Nothing changed, nothing sent.
+  {
+    const auto delta = participation.collectDelta();
+    ASSERT_EQ(bool(delta.state), false);
+    ASSERT_EQ(bool(delta.stateDelta), false);
+    ASSERT_EQ(delta.needsReliable(), false);
+  }
+
+  // Only the changed field is sent.
+  {
+    participation.plane->damage(0.5);
+    const auto delta = participation.collectDelta();
+    ASSERT_EQ(bool(delta.stateDelta), true);
+    ASSERT_EQ(bool(delta.stateDelta->health), true);
+    ASSERT_EQ(bool(delta.stateDelta->pos), false);
+
+    remoteParticip.applyDelta(delta);
+    ASSERT_EQ(remoteParticip.plane->getState().health,
+              participation.plane->getState().health);
+
+    // the change is repeated until the next keyframe, in case it was lost
+    ASSERT_EQ(bool(participation.collectDelta().stateDelta), true);
+  }
+
+  // Keyframes arrive periodically, and go reliably.
+  {
+    unsigned int keyframes = 0;
+    for (unsigned int i = 0; i < sky::Sky::keyframeInterval; i++) {
+      const auto delta = sky.collectDelta();
+      if (delta.participations.at(player.pid).state) {
+        ASSERT_EQ(delta.needsReliable(), true);
+        keyframes++;
+      }
+    }
+    ASSERT_EQ(keyframes, 1u);
+  }
+}
+
 /**
  * Props can be spawned by Participations, and are Networked correctly
  */
@@ -140,12 +285,313 @@ TEST_F(SkyTest, PropTest) {
   ASSERT_EQ(remoteParticipation.props.size(), size_t(1));
 
   participation.spawnProp(sky::PropInit());
-  remoteSky.applyDelta(sky.collectDelta());
+  const auto delta = sky.collectDelta();
+  ASSERT_EQ(delta.needsReliable(), false);
+
+  // The spawn goes reliably on its own; the delta collected with it keeps
+  // the prop, whichever arrives first.
+  remoteSky.applyPropSpawns(sky.collectPropSpawns(), 0);
+  remoteSky.applyDelta(delta);
+
+  ASSERT_EQ(remoteParticipation.props.size(), size_t(2));
+
+  // A snapshot collected before a spawn, arriving after it, doesn't erase
+  // the new prop; later ones still erase those that died.
+  const auto earlier = sky.collectDelta();
+  participation.spawnProp(sky::PropInit());
+  remoteSky.applyPropSpawns(sky.collectPropSpawns(), 2);
+  remoteSky.applyDelta(earlier, 1);
+  ASSERT_EQ(remoteParticipation.props.size(), size_t(3));
 
+  participation.props.begin()->second.destroy();
+  arena.tick(0.1);
+  remoteSky.applyDelta(sky.collectDelta(), 3);
   ASSERT_EQ(remoteParticipation.props.size(), size_t(2));
 
 }
 
+/**
+ * Prop bodies come from a pool in Physics, which grows when it runs dry, and
+ * go back to it inactive.
+ */
+TEST_F(SkyTest, PropPoolTest) {
+  QuietListener listener;
+  sky::Physics physics(nullMap, listener);
+  const auto tag = sky::BodyTag::BoundaryTag();
+
+  // A released body is inactive, and the next one handed out.
+  b2Body *const body = physics.acquirePropBody(tag);
+  EXPECT_TRUE(body->IsActive());
+  physics.releasePropBody(body);
+  EXPECT_FALSE(body->IsActive());
+  EXPECT_EQ(physics.acquirePropBody(tag), body);
+
+  // Past the bodies made up front, more are made.
+  std::set<b2Body *> bodies{body};
+  for (int i = 0; i < 100; i++) {
+    b2Body *const acquired = physics.acquirePropBody(tag);
+    EXPECT_TRUE(acquired->IsActive());
+    bodies.insert(acquired);
+  }
+  EXPECT_EQ(bodies.size(), size_t(101));
+
+  // A prop takes a body from the pool, and gives it back when it goes.
+  physics.releasePropBody(body);
+  {
+    sky::Prop prop(0, physics, sky::PropInit({100, 100}, {}));
+    EXPECT_TRUE(body->IsActive());
+    EXPECT_NE(body->GetUserData(), nullptr);
+  }
+  EXPECT_FALSE(body->IsActive());
+  EXPECT_EQ(body->GetUserData(), nullptr);
+  EXPECT_EQ(physics.acquirePropBody(tag), body);
+}
+
+/**
+ * Props are sensors: they pass through each other and obstacles untouched,
+ * but still hit planes. A prop's body only takes its state after a delta.
+ */
+TEST_F(SkyTest, SensorTest) {
+  std::istringstream source(R"({
+    "dimensions": {"x": 1600, "y": 900},
+    "obstacles": [{"pos": {"x": 600, "y": 400}, "damage": 0,
+                   "localVertices": [{"x": 0, "y": 0}, {"x": 100, "y": 0},
+                                     {"x": 100, "y": 100}, {"x": 0, "y": 100}]}],
+    "spawnPoints": []
+  })");
+  const auto map = sky::Map::load(source);
+  ASSERT_TRUE(bool(map));
+
+  sky::Arena sensorArena(
+      sky::ArenaInit("sensor arena", "NULL", sky::ArenaMode::Lobby));
+  sky::Sky sensorSky(sensorArena, *map, sky::SkyInit());
+  sensorArena.connectPlayer("target");
+  sensorArena.connectPlayer("shooter");
+  auto &target = *sensorArena.getPlayer(0);
+  auto &shooter = sensorSky.getParticipation(*sensorArena.getPlayer(1));
+  target.spawn({}, {300, 700}, 0);
+
+  shooter.spawnProp(sky::PropInit({100, 100}, {100, 0}));
+  shooter.spawnProp(sky::PropInit({110, 100}, {-100, 0})); // crossing it
+  shooter.spawnProp(sky::PropInit({550, 450}, {200, 0})); // into the obstacle
+  shooter.spawnProp(sky::PropInit({300, 700}, {})); // on the plane
+  const auto prop = [&](const PID pid) -> const sky::PhysicalState & {
+    return shooter.props.find(pid)->second.getPhysical();
+  };
+
+  sensorArena.tick(0.25);
+  EXPECT_NEAR(prop(0).vel.x, 100, 0.01);
+  EXPECT_NEAR(prop(1).vel.x, -100, 0.01);
+  EXPECT_NEAR(prop(0).pos.x, 125, 0.01);
+  EXPECT_NEAR(prop(1).pos.x, 85, 0.01);
+  EXPECT_NEAR(prop(2).vel.x, 200, 0.01);
+  EXPECT_NEAR(prop(2).pos.x, 600, 0.01);
+  sensorArena.tick(0.25);
+  EXPECT_NEAR(prop(2).vel.x, 200, 0.01);
+  EXPECT_NEAR(prop(2).pos.x, 650, 0.01); // inside it
+  EXPECT_FALSE(sensorSky.getParticipation(target).isSpawned()
+                   and sensorSky.getParticipation(target).plane
+                       ->getState().health > 0);
+
+  // A delta moves the body; the ticks after carry on from there.
+  sky::PropDelta delta;
+  delta.physical = sky::PhysicalState({1000, 200}, {0, 100}, 0, 0);
+  shooter.props.find(0)->second.applyDelta(delta);
+  sensorArena.tick(0.25);
+  EXPECT_NEAR(prop(0).pos.x, 1000, 0.01);
+  EXPECT_NEAR(prop(0).pos.y, 225, 0.01);
+  sensorArena.tick(0.25);
+  EXPECT_NEAR(prop(0).pos.y, 250, 0.01);
+}
+
+/**
+ * Plane state deltas only apply over the keyframe they're relative to, and a
+ * keyframe arriving late doesn't move the plane back in time.
+ */
+TEST_F(SkyTest, KeyframeTest) {
+  arena.connectPlayer("nameless plane");
+  auto &player = *arena.getPlayer(0);
+  auto &participation = sky.getParticipation(player);
+
+  sky::Arena remoteArena{arena.captureInitializer()};
+  sky::Sky remoteSky{remoteArena, nullMap, sky.captureInitializer()};
+  auto &remoteParticip = remoteSky.getParticipation(*remoteArena.getPlayer(0));
+
+  player.spawn({}, {200, 200}, 0);
+  remoteSky.applyDelta(sky.collectDelta());
+  const float health = remoteParticip.plane->getState().health;
+
+  participation.plane->damage(0.5);
+  optional<sky::SkyDelta> keyframe;
+  while (!keyframe) {
+    auto delta = sky.collectDelta();
+    if (delta.needsReliable()) keyframe = std::move(delta);
+  }
+  participation.plane->damage(0.25);
+
+  // A snapshot overtaking its keyframe is no use.
+  remoteSky.applyDelta(sky.collectDelta());
+  EXPECT_FLOAT_EQ(remoteParticip.plane->getState().health, health);
+
+  // The keyframe arrives after it; the next snapshot builds on it.
+  remoteSky.applyLateDelta(*keyframe);
+  EXPECT_FLOAT_EQ(remoteParticip.plane->getState().health, health);
+  remoteSky.applyDelta(sky.collectDelta());
+  EXPECT_FLOAT_EQ(remoteParticip.plane->getState().health,
+                  participation.plane->getState().health);
+}
+
+/**
+ * A client whose reliable deltas were held back catches up from a resync of
+ * the latest keyframe.
+ */
+TEST_F(SkyTest, ResyncTest) {
+  arena.connectPlayer("nameless plane");
+  auto &player = *arena.getPlayer(0);
+  auto &participation = sky.getParticipation(player);
+
+  sky::Arena remoteArena{arena.captureInitializer()};
+  sky::Sky remoteSky{remoteArena, nullMap, sky.captureInitializer()};
+  auto &remoteParticip = remoteSky.getParticipation(*remoteArena.getPlayer(0));
+
+  // The client misses the spawn, and a keyframe after it.
+  player.spawn({}, {200, 200}, 0);
+  sky.collectDelta();
+  participation.plane->damage(0.5);
+  while (!sky.collectDelta().needsReliable()) { }
+  const float keyframeHealth = participation.plane->getState().health;
+  participation.plane->damage(0.25);
+
+  auto delta = sky.collectDelta();
+  remoteSky.applyDelta(delta);
+  EXPECT_FALSE(remoteParticip.isSpawned());
+
+  // The resync brings the plane as of the keyframe; snapshots build on it.
+  auto &resynced = delta.participations.at(player.pid);
+  resynced = participation.resyncDelta(resynced, true);
+  EXPECT_TRUE(resynced.needsReliable());
+  remoteSky.applyDelta(delta);
+  ASSERT_TRUE(remoteParticip.isSpawned());
+  EXPECT_FLOAT_EQ(remoteParticip.plane->getState().health, keyframeHealth);
+
+  remoteSky.applyDelta(sky.collectDelta());
+  EXPECT_FLOAT_EQ(remoteParticip.plane->getState().health,
+                  participation.plane->getState().health);
+}
+
+/**
+ * Players spawn at their team's spawn points, as far from enemies as they
+ * can.
+ */
+TEST_F(SkyTest, SpawnTest) {
+  std::istringstream source(R"({
+    "dimensions": {"x": 1600, "y": 900},
+    "obstacles": [],
+    "spawnPoints": [
+      {"pos": {"x": 200, "y": 200}, "angle": {"angle": 0}, "team": 1},
+      {"pos": {"x": 1400, "y": 200}, "angle": {"angle": 0}, "team": 1},
+      {"pos": {"x": 800, "y": 700}, "angle": {"angle": 0}, "team": 2}]
+  })");
+  const auto map = sky::Map::load(source);
+  ASSERT_TRUE(bool(map));
+
+  sky::Arena teamArena(
+      sky::ArenaInit("team arena", "NULL", sky::ArenaMode::Game));
+  sky::Sky teamSky(teamArena, *map, sky::SkyInit());
+  teamArena.connectPlayer("red plane");
+  teamArena.connectPlayer("blue plane");
+  auto &red = *teamArena.getPlayer(0), &blue = *teamArena.getPlayer(1);
+
+  const auto joinTeam = [&](sky::Player &player, const sky::Team team) {
+    sky::PlayerDelta delta{player};
+    delta.team = team;
+    teamArena.applyDelta(sky::ArenaDelta::Delta(player.pid, delta));
+  };
+  joinTeam(red, sky::Team::Red);
+  joinTeam(blue, sky::Team::Blue);
+
+  // Blue only has the one spawn point.
+  EXPECT_EQ(teamSky.pickSpawnPoint(blue).pos, sf::Vector2f(800, 700));
+
+  // With blue by one red spawn point, red spawns at the other.
+  blue.spawn({}, {300, 250}, 0);
+  EXPECT_EQ(teamSky.pickSpawnPoint(red).pos, sf::Vector2f(1400, 200));
+  teamSky.getParticipation(blue).suicide();
+  blue.spawn({}, {1300, 200}, 0);
+  EXPECT_EQ(teamSky.pickSpawnPoint(red).pos, sf::Vector2f(200, 200));
+}
+
+/**
+ * PlaneHistory rewinds a plane between the ticks it recorded, and keeps a
+ * bounded number of them.
+ */
+TEST_F(SkyTest, HistoryTest) {
+  sky::PlaneHistory history;
+  ASSERT_FALSE(bool(history.rewind(0)));
+
+  const auto at = [](const float x) {
+    return sky::PhysicalState({x, 0}, {}, 0, 0);
+  };
+  const size_t ticks = 2 * sky::PlaneHistory::capacity;
+  for (size_t i = 0; i < ticks; i++) history.record(i * 0.5, at(i * 10));
+
+  // Between records.
+  EXPECT_FLOAT_EQ(history.rewind(50.25)->pos.x, 1005);
+  // Clamped to the newest, and to the oldest we still have.
+  EXPECT_FLOAT_EQ(history.rewind(1000)->pos.x, (ticks - 1) * 10);
+  EXPECT_FLOAT_EQ(history.rewind(0)->pos.x,
+                  sky::PlaneHistory::capacity * 10);
+
+  history.clear();
+  EXPECT_TRUE(history.isEmpty());
+}
+
+/**
+ * Hit tests use where a plane was when the shooter saw it, not where it is.
+ */
+TEST_F(SkyTest, RewindHitTest) {
+  sky::PlaneHistory history;
+  const sf::Vector2f hitbox(40, 20);
+  // flying right at 600px/s, recorded every tick
+  for (int i = 0; i <= 60; i++)
+    history.record(i / 60.0, sky::PhysicalState({i * 10.0f, 300}, {}, 0, 0));
+
+  // A shot at where the plane was a third of a second ago.
+  const sf::Vector2f shot(400, 305);
+  EXPECT_TRUE(history.contains(1 - 1 / 3.0, hitbox, shot));
+  EXPECT_FALSE(history.contains(1, hitbox, shot));
+
+  // Still a miss to the side of it, or behind it.
+  EXPECT_FALSE(history.contains(1 - 1 / 3.0, hitbox, {400, 315}));
+  EXPECT_FALSE(history.contains(1 - 1 / 3.0, hitbox, {370, 300}));
+}
+
+/**
+ * The view delay a client claims is capped at what a SnapshotBuffer would
+ * delay, so it can't buy itself more rewind.
+ */
+TEST_F(SkyTest, ViewDelayTest) {
+  arena.connectPlayer("nameless plane");
+  auto &participation = sky.getParticipation(*arena.getPlayer(0));
+
+  sky::ParticipationInput input;
+  input.sequence = 1;
+  input.viewDelay = 0.1f;
+  participation.applyInput(input);
+  EXPECT_FLOAT_EQ(participation.getViewDelay(), 0.1f);
+
+  input.sequence = 2;
+  input.viewDelay = 5.0f;
+  participation.applyInput(input);
+  EXPECT_FLOAT_EQ(participation.getViewDelay(),
+                  sky::SnapshotBufferSettings().maxDelay);
+
+  input.sequence = 3;
+  input.viewDelay = -1.0f;
+  participation.applyInput(input);
+  EXPECT_FLOAT_EQ(participation.getViewDelay(), 0);
+}
+
 /**
  * Tuning values can be accessed by name, for use in the rcon and sanbox.
  */
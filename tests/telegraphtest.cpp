@@ -122,3 +122,78 @@ TEST_F(TelegraphTest, Invariant) {
     ASSERT_EQ(bool(packet), false);
   }
 }
+
+/**
+ * Sky packets are packed against the map dimensions both ends' telegraphs
+ * were given, rather than dimensions sent in every packet.
+ */
+TEST_F(TelegraphTest, PackingBounds) {
+  using namespace sky;
+  const sf::Vector2f dims{1600, 900};
+  serverTelegraph.setPackingBounds(dims);
+  clientTelegraph.setPackingBounds(dims);
+
+  SkyPropSpawns spawns;
+  spawns.props[2].emplace(0, PropInit({100.3f, 200.7f}, {0, 50}));
+  const auto spawnPacket = ServerPacket::SpawnProps(spawns, 1);
+  serverTelegraph.transmit(server, clientPeer, spawnPacket);
+  event = processHosts(client, server);
+  const optional<ServerPacket> &packet =
+      clientTelegraph.receive(event.packet);
+
+  ASSERT_EQ(bool(packet), true);
+  const auto &physical = packet->propSpawns->props.at(2).at(0).physical;
+  EXPECT_NEAR(physical.pos.x, 100.3f, 0.01);
+  EXPECT_NEAR(physical.pos.y, 200.7f, 0.01);
+
+  // quantized, so smaller than without bounds
+  tg::Telegraph<ServerPacket> unbounded;
+  EXPECT_LT(serverTelegraph.outputToString(spawnPacket).size(),
+            unbounded.outputToString(spawnPacket).size());
+}
+
+/**
+ * Packet buffers are recycled once ENet is done with their packets.
+ */
+TEST_F(TelegraphTest, PacketPool) {
+  tg::PacketPool pool;
+
+  auto buffer = pool.acquire();
+  const tg::PacketBuffer *const original = buffer.get();
+  std::ostream stream(buffer.get());
+  stream << "some data";
+  EXPECT_EQ(buffer->size(), size_t(9));
+
+  ENetPacket *packet = pool.wrap(std::move(buffer),
+                                 ENET_PACKET_FLAG_RELIABLE);
+  ASSERT_NE(packet, nullptr);
+  EXPECT_EQ(packet->dataLength, size_t(9));
+  EXPECT_EQ(pool.idleCount(), size_t(0));
+
+  enet_packet_destroy(packet);
+  EXPECT_EQ(pool.idleCount(), size_t(1));
+
+  buffer = pool.acquire();
+  EXPECT_EQ(buffer.get(), original);
+  EXPECT_EQ(buffer->size(), size_t(0));
+}
+
+/**
+ * Hosts keep track of their peers as they come and go.
+ */
+TEST_F(TelegraphTest, PeerTable) {
+  ASSERT_EQ(server.getPeers().size(), size_t(1));
+
+  tg::Host otherClient(tg::HostType::Client);
+  otherClient.connect("localhost", 4242);
+  event = processHosts(server, otherClient);
+  ASSERT_EQ(event.type, ENET_EVENT_TYPE_CONNECT);
+  ENetPeer *const otherPeer = event.peer;
+  ASSERT_EQ(server.getPeers().size(), size_t(2));
+
+  client.disconnect(serverPeer);
+  event = processHosts(server, client);
+  ASSERT_EQ(event.type, ENET_EVENT_TYPE_DISCONNECT);
+  ASSERT_EQ(server.getPeers().size(), size_t(1));
+  EXPECT_EQ(server.getPeers()[0], otherPeer);
+}
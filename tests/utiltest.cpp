@@ -2,6 +2,8 @@
 #include <gtest/gtest.h>
 #include "util/types.hpp"
 #include "util/methods.hpp"
+#include "util/slotmap.hpp"
+#include "util/workerpool.hpp"
 
 /**
  * The basic utilities we have in src/util.
@@ -71,6 +73,89 @@ TEST_F(UtilTest, AllocTest) {
   EXPECT_EQ(smallestUnused(x), PID(5));
 }
 
+/**
+ * WorkerPool runs what it's given, and jobs cancelled before they start
+ * don't run.
+ */
+TEST_F(UtilTest, WorkerPoolTest) {
+  std::atomic<int> ran(0);
+  std::mutex blocker;
+  std::unique_lock<std::mutex> blocking(blocker);
+  WorkerPool pool(1);
+  const auto busy = pool.submit([&](const PoolJob &) {
+    std::lock_guard<std::mutex> lock(blocker);
+    ++ran;
+  });
+  const auto queued = pool.submit([&](const PoolJob &) { ++ran; });
+  const auto cancelled = pool.submit([&](const PoolJob &) { ran += 10; });
+
+  cancelled->cancel();
+  EXPECT_TRUE(cancelled->isCancelled());
+  EXPECT_FALSE(busy->isFinished());
+  blocking.unlock();
+
+  cancelled->wait();
+  queued->wait();
+  EXPECT_TRUE(busy->isFinished());
+  EXPECT_EQ(ran, 2);
+
+  // Jobs can watch for cancellation while they run.
+  std::atomic<bool> started(false);
+  const auto polling = pool.submit([&](const PoolJob &job) {
+    started = true;
+    while (!job.isCancelled()) std::this_thread::yield();
+    ++ran;
+  });
+  while (!started) std::this_thread::yield();
+  polling->cancel();
+  polling->wait();
+  EXPECT_EQ(ran, 3);
+}
+
+/**
+ * SlotMap behaves like a std::map, and values stay where they're put.
+ */
+TEST_F(UtilTest, SlotMapTest) {
+  SlotMap<std::string> map;
+  std::vector<const std::string *> addresses;
+  for (PID pid = 0; pid < 40; pid++) {
+    auto result = map.emplace(std::piecewise_construct,
+                              std::forward_as_tuple(pid),
+                              std::forward_as_tuple(std::to_string(pid)));
+    EXPECT_TRUE(result.second);
+    addresses.push_back(&result.first->second);
+  }
+  EXPECT_EQ(map.size(), size_t(40));
+  EXPECT_FALSE(map.emplace(std::piecewise_construct,
+                           std::forward_as_tuple(3),
+                           std::forward_as_tuple("three")).second);
+  EXPECT_EQ(map.find(3)->second, "3");
+
+  // Erasing while iterating.
+  auto iter = map.begin();
+  while (iter != map.end()) {
+    if (iter->first % 2 == 0) {
+      const auto toErase = iter;
+      ++iter;
+      map.erase(toErase);
+    } else ++iter;
+  }
+  EXPECT_EQ(map.size(), size_t(20));
+  EXPECT_TRUE(map.find(4) == map.end());
+  EXPECT_EQ(smallestUnused(map), PID(0));
+  for (const auto &entry : map) {
+    EXPECT_EQ(entry.first % 2, PID(1));
+    EXPECT_EQ(&entry.second, addresses[entry.first]);
+  }
+
+  // Freed slots get reused.
+  map.emplace(std::piecewise_construct,
+              std::forward_as_tuple(100), std::forward_as_tuple("100"));
+  EXPECT_EQ(&map.find(100)->second, addresses[0]);
+  EXPECT_EQ(map.erase(100), size_t(1));
+  EXPECT_EQ(map.erase(100), size_t(0));
+}
+
 /**
  * We can read stuff from strings.
  */